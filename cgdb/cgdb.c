@@ -70,6 +70,8 @@
 #include "interface.h"
 #include "scroller.h"
 #include "sources.h"
+#include "highlight.h"
+#include "project.h"
 #include "tgdb.h"
 #include "kui.h"
 #include "kui_term.h"
@@ -967,6 +969,7 @@ static void process_commands(struct tgdb *tgdb)
                 }
 
                 if_show_file(NULL, 0);
+                source_prefetch(sview);
                 break;
             }
 
@@ -994,17 +997,33 @@ static void process_commands(struct tgdb *tgdb)
                 struct tgdb_list *list =
                         item->choice.update_source_files.source_files;
                 tgdb_list_iterator *i = tgdb_list_get_first(list);
+                char **files;
+                int count = 0;
                 char *s;
 
                 if_clear_filedlg();
 
+                while (i) {
+                    count++;
+                    i = tgdb_list_next(i);
+                }
+
+                files = (char **) cgdb_malloc(sizeof (char *) * (count + 1));
+                count = 0;
+                i = tgdb_list_get_first(list);
                 while (i) {
                     s = tgdb_list_get_item(i);
                     if_add_filedlg_choice(s);
+                    files[count++] = s;
                     i = tgdb_list_next(i);
                 }
 
-                if_set_focus(FILE_DLG);
+                /* Index the files for :grep in the background */
+                project_set_files(files, count);
+                free(files);
+
+                if (!if_project_search_files())
+                    if_set_focus(FILE_DLG);
                 kui_input_acceptable = 1;
                 break;
             }
@@ -1013,6 +1032,7 @@ static void process_commands(struct tgdb *tgdb)
                  * the debugged program but libtgdb is claiming that gdb knows
                  * none. */
             case TGDB_SOURCES_DENIED:
+                if_project_search_cancel();
                 if_display_message("Error:", 0,
                         " No sources available! Was the program compiled with debug?");
                 kui_input_acceptable = 1;
@@ -1381,6 +1401,21 @@ static int main_loop(void)
          * each time in the loop.
          */
         int tty_fd = tgdb_get_inferior_fd(tgdb);
+        int hl_fd = highlight_worker_fd();
+        int watch_fd = source_watch_fd(if_get_sview());
+        int render_timeout;
+        struct timeval timeout, *timeoutp = NULL;
+
+        /* Draw the output that arrived since the last frame if it is time,
+         * otherwise wake up when it is */
+        render_timeout = if_render_timeout();
+        if (render_timeout == 0)
+            if_render();
+        else if (render_timeout > 0) {
+            timeout.tv_sec = render_timeout / 1000;
+            timeout.tv_usec = (render_timeout % 1000) * 1000;
+            timeoutp = &timeout;
+        }
 
         max = (gdb_fd > STDIN_FILENO) ? gdb_fd : STDIN_FILENO;
         max = (max > tty_fd) ? max : tty_fd;
@@ -1388,6 +1423,8 @@ static int main_loop(void)
         max = (max > signal_pipe[0]) ? max : signal_pipe[0];
         max = (max > slavefd) ? max : slavefd;
         max = (max > masterfd) ? max : masterfd;
+        max = (max > hl_fd) ? max : hl_fd;
+        max = (max > watch_fd) ? max : watch_fd;
 
         /* Reset the fd_set, and watch for input from GDB or stdin */
         FD_ZERO(&rset);
@@ -1396,6 +1433,10 @@ static int main_loop(void)
         FD_SET(tty_fd, &rset);
         FD_SET(resize_pipe[0], &rset);
         FD_SET(signal_pipe[0], &rset);
+        if (hl_fd != -1)
+            FD_SET(hl_fd, &rset);
+        if (watch_fd != -1)
+            FD_SET(watch_fd, &rset);
 
         /* No readline activity allowed while displaying tab completion */
         if (!is_tab_completing) {
@@ -1404,7 +1445,7 @@ static int main_loop(void)
         }
 
         /* Wait for input */
-        if (select(max + 1, &rset, NULL, NULL, NULL) == -1) {
+        if (select(max + 1, &rset, NULL, NULL, timeoutp) == -1) {
             if (errno == EINTR)
                 continue;
             else {
@@ -1424,6 +1465,14 @@ static int main_loop(void)
             if (cgdb_resize_term(resize_pipe[0]) == -1)
                 return -1;
 
+        /* The highlight worker finished some lines */
+        if (hl_fd != -1 && FD_ISSET(hl_fd, &rset))
+            if_highlight_ready();
+
+        /* A loaded source file changed */
+        if (watch_fd != -1 && FD_ISSET(watch_fd, &rset))
+            source_watch_ready(if_get_sview());
+
         /* Input received through the pty:  Handle it 
          * Wrote to masterfd, now slavefd is ready, tell readline */
         if (FD_ISSET(slavefd, &rset))
@@ -1524,6 +1573,8 @@ void cleanup()
      */
 
     /* Shut down interface */
+    highlight_worker_stop();
+    project_shutdown();
     if_shutdown();
 
 #if 0
@@ -1829,6 +1880,18 @@ int main(int argc, char *argv[])
         exit(-1);
     }
 
+    /* Keep highlighted files across runs */
+    highlight_cache_init(cgdb_home_dir);
+
+    /* Keep the index of the source files for :grep across runs */
+    project_init(cgdb_home_dir);
+
+    /* Highlight files in the background. Without the worker, files are
+     * highlighted as they are displayed. */
+    if (highlight_worker_start() == -1)
+        logger_write_pos(logger, __FILE__, __LINE__,
+                "highlight_worker_start error");
+
     {
         char config_file[FSUTIL_PATH_MAX];
         FILE *config;
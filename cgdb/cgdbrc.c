@@ -14,6 +14,10 @@
 #include <stdlib.h>
 #endif /* HAVE_STDLIB_H */
 
+#if HAVE_CTYPE_H
+#include <ctype.h>
+#endif /* HAVE_CTYPE_H */
+
 #include "cgdbrc.h"
 #include "command_lexer.h"
 #include "tgdb.h"
@@ -54,6 +58,11 @@ static int command_set_ttimeoutlen(int value);
 static int command_set_winminheight(int value);
 static int command_set_syntax_type(const char *value);
 static int command_set_stc(int value);
+static int command_set_largefile(int value);
+static int command_set_maxmemtot(int value);
+static int command_set_refreshrate(int value);
+static int command_set_gdbscrollback(int value);
+static int command_set_ttyscrollback(int value);
 static int cgdbrc_set_val(struct cgdbrc_config_option config_option);
 
 /**
@@ -64,7 +73,12 @@ static struct cgdbrc_config_option cgdbrc_config_options[CGDBRC_WRAPSCAN + 1] =
     {CGDBRC_ARROWSTYLE, {ARROWSTYLE_SHORT}},
     {CGDBRC_AUTOSOURCERELOAD, {1}},
     {CGDBRC_CGDB_MODE_KEY, {CGDB_KEY_ESC}},
+    {CGDBRC_GDBSCROLLBACK, {10000}},
+    {CGDBRC_HLSEARCH, {0}},
     {CGDBRC_IGNORECASE, {0}},
+    {CGDBRC_LARGEFILE, {16384}},
+    {CGDBRC_MAXMEMTOT, {65536}},
+    {CGDBRC_REFRESHRATE, {60}},
     {CGDBRC_SHOWTGDBCOMMANDS, {0}},
     {CGDBRC_SYNTAX, {TOKENIZER_LANGUAGE_UNKNOWN}},
     {CGDBRC_TABSTOP, {8}},
@@ -72,11 +86,15 @@ static struct cgdbrc_config_option cgdbrc_config_options[CGDBRC_WRAPSCAN + 1] =
     {CGDBRC_TIMEOUT_LEN, {1000}},
     {CGDBRC_TTIMEOUT, {1}},
     {CGDBRC_TTIMEOUT_LEN, {100}},
+    {CGDBRC_TTYSCROLLBACK, {10000}},
     {CGDBRC_WINMINHEIGHT, {0}},
     {CGDBRC_WINSPLIT, {WIN_SPLIT_EVEN}},
     {CGDBRC_WRAPSCAN, {1}}
 };
 
+/* The line command_parse_string is parsing */
+static const char *command_line = "";
+
 static struct std_list *cgdbrc_attach_list;
 static unsigned long cgdbrc_attach_handle = 1;
 struct cgdbrc_attach_item {
@@ -104,10 +122,26 @@ static struct ConfigVariable {
     {
     "cgdbmodekey", "cgdbmodekey", CONFIG_TYPE_FUNC_STRING,
                 command_set_cgdb_mode_key},
+            /* gdbscrollback */
+    {
+    "gdbscrollback", "gsb", CONFIG_TYPE_FUNC_INT, &command_set_gdbscrollback},
+            /* hlsearch */
+    {
+    "hlsearch", "hls", CONFIG_TYPE_BOOL,
+                &cgdbrc_config_options[CGDBRC_HLSEARCH].variant.int_val},
             /* ignorecase */
     {
     "ignorecase", "ic", CONFIG_TYPE_BOOL,
                 &cgdbrc_config_options[CGDBRC_IGNORECASE].variant.int_val},
+            /* largefile */
+    {
+    "largefile", "lf", CONFIG_TYPE_FUNC_INT, &command_set_largefile},
+            /* maxmemtot */
+    {
+    "maxmemtot", "mmt", CONFIG_TYPE_FUNC_INT, &command_set_maxmemtot},
+            /* refreshrate */
+    {
+    "refreshrate", "rr", CONFIG_TYPE_FUNC_INT, &command_set_refreshrate},
             /* showtgdbcommands */
     {
     "showtgdbcommands", "stc", CONFIG_TYPE_FUNC_BOOL, &command_set_stc},
@@ -130,6 +164,9 @@ static struct ConfigVariable {
             /* ttimeoutlen   */
     {
     "ttimeoutlen", "ttm", CONFIG_TYPE_FUNC_INT, &command_set_ttimeoutlen},
+            /* ttyscrollback */
+    {
+    "ttyscrollback", "tsb", CONFIG_TYPE_FUNC_INT, &command_set_ttyscrollback},
             /* winminheight */
     {
     "winminheight", "wmh", CONFIG_TYPE_FUNC_INT, &command_set_winminheight},
@@ -149,7 +186,9 @@ static int command_focus_tty(int param);
 
 static int command_do_bang(int param);
 static int command_do_focus(int param);
+static int command_do_grep(int param);
 static int command_do_help(int param);
+static int command_do_nohlsearch(int param);
 static int command_do_quit(int param);
 static int command_do_shell(int param);
 static int command_source_reload(int param);
@@ -173,6 +212,8 @@ COMMANDS commands[] = {
     /* edit         */ {"edit", command_source_reload, 0},
     /* edit         */ {"e", command_source_reload, 0},
     /* focus        */ {"focus", command_do_focus, 0},
+    /* grep         */ {"grep", command_do_grep, 0},
+    /* grep         */ {"gr", command_do_grep, 0},
     /* help         */ {"help", command_do_help, 0},
     /* highlight            */ {"highlight", command_parse_highlight, 0},
     /* highlight            */ {"hi", command_parse_highlight, 0},
@@ -182,6 +223,8 @@ COMMANDS commands[] = {
     /* iunmap       */ {"iu", command_parse_unmap, 0},
     /* insert       */ {"insert", command_focus_gdb, 0},
     /* map          */ {"map", command_parse_map, 0},
+    /* nohlsearch   */ {"nohlsearch", command_do_nohlsearch, 0},
+    /* nohlsearch   */ {"noh", command_do_nohlsearch, 0},
     /* quit         */ {"quit", command_do_quit, 0},
     /* quit         */ {"q", command_do_quit, 0},
     /* shell        */ {"shell", command_do_shell, 0},
@@ -336,6 +379,83 @@ int command_set_winsplit(const char *value)
     return 0;
 }
 
+static int command_set_largefile(int value)
+{
+    if (value >= 0) {
+        struct cgdbrc_config_option option;
+
+        option.option_kind = CGDBRC_LARGEFILE;
+        option.variant.int_val = value;
+
+        if (cgdbrc_set_val(option))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int command_set_maxmemtot(int value)
+{
+    if (value >= 0) {
+        struct cgdbrc_config_option option;
+
+        option.option_kind = CGDBRC_MAXMEMTOT;
+        option.variant.int_val = value;
+
+        if (cgdbrc_set_val(option))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int command_set_refreshrate(int value)
+{
+    if (value >= 0) {
+        struct cgdbrc_config_option option;
+
+        option.option_kind = CGDBRC_REFRESHRATE;
+        option.variant.int_val = value;
+
+        if (cgdbrc_set_val(option))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int command_set_gdbscrollback(int value)
+{
+    if (value > 0) {
+        struct cgdbrc_config_option option;
+
+        option.option_kind = CGDBRC_GDBSCROLLBACK;
+        option.variant.int_val = value;
+
+        if (cgdbrc_set_val(option))
+            return 1;
+        if_set_scrollback();
+    }
+
+    return 0;
+}
+
+static int command_set_ttyscrollback(int value)
+{
+    if (value > 0) {
+        struct cgdbrc_config_option option;
+
+        option.option_kind = CGDBRC_TTYSCROLLBACK;
+        option.variant.int_val = value;
+
+        if (cgdbrc_set_val(option))
+            return 1;
+        if_set_scrollback();
+    }
+
+    return 0;
+}
+
 static int command_set_winminheight(int value)
 {
     struct cgdbrc_config_option option;
@@ -483,12 +603,48 @@ int command_do_focus(int param)
     return 0;
 }
 
+int command_do_grep(int param)
+{
+    const char *pattern = command_line;
+    char *regex;
+    int length;
+
+    /* The pattern is the rest of the line, the lexer would split it */
+    while (isspace((unsigned char) *pattern) || *pattern == ':')
+        pattern++;
+    while (*pattern && !isspace((unsigned char) *pattern))
+        pattern++;
+    while (isspace((unsigned char) *pattern))
+        pattern++;
+
+    length = strlen(pattern);
+    while (length > 0 && (pattern[length - 1] == '\n' ||
+                    pattern[length - 1] == '\r'))
+        length--;
+
+    if (length == 0)
+        return 1;
+
+    regex = cgdb_strdup(pattern);
+    regex[length] = '\0';
+    if_project_search(regex);
+    free(regex);
+
+    return 0;
+}
+
 int command_do_help(int param)
 {
     if_display_help();
     return 0;
 }
 
+int command_do_nohlsearch(int param)
+{
+    if_nohlsearch();
+    return 0;
+}
+
 int command_do_quit(int param)
 {
     /* FIXME: Test to see if debugged program is still running */
@@ -557,6 +713,9 @@ int command_parse_syntax(int param)
 
 static int command_parse_highlight(int param)
 {
+    /* The colors of the source window may have changed */
+    source_damage(if_get_sview());
+
     return hl_groups_parse_config(hl_groups_instance);
 }
 
@@ -791,6 +950,8 @@ int command_parse_string(const char *buffer)
     int rv = 1;
     YY_BUFFER_STATE state = yy_scan_string((char *) buffer);
 
+    command_line = buffer;
+
     switch (yylex()) {
         case SET:
             /* get the next token */
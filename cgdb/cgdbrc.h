@@ -104,7 +104,12 @@ enum cgdbrc_option_kind {
     CGDBRC_ARROWSTYLE,
     CGDBRC_AUTOSOURCERELOAD,
     CGDBRC_CGDB_MODE_KEY,
+    CGDBRC_GDBSCROLLBACK,
+    CGDBRC_HLSEARCH,
     CGDBRC_IGNORECASE,
+    CGDBRC_LARGEFILE,
+    CGDBRC_MAXMEMTOT,
+    CGDBRC_REFRESHRATE,
     CGDBRC_SHOWTGDBCOMMANDS,
     CGDBRC_SYNTAX,
     CGDBRC_TABSTOP,
@@ -112,6 +117,7 @@ enum cgdbrc_option_kind {
     CGDBRC_TIMEOUT_LEN,
     CGDBRC_TTIMEOUT,
     CGDBRC_TTIMEOUT_LEN,
+    CGDBRC_TTYSCROLLBACK,
     CGDBRC_WINMINHEIGHT,
     CGDBRC_WINSPLIT,
     CGDBRC_WRAPSCAN
@@ -125,13 +131,19 @@ struct cgdbrc_config_option {
         enum ArrowStyle arrow_style;
         /* option_kind == CGDBRC_AUTOSOURCERELOAD */
         /* option_kind == CGDBRC_CGDB_MODE_KEY */
+        /* option_kind == CGDBRC_GDBSCROLLBACK */
+        /* option_kind == CGDBRC_HLSEARCH */
         /* option_kind == CGDBRC_IGNORECASE */
+        /* option_kind == CGDBRC_LARGEFILE */
+        /* option_kind == CGDBRC_MAXMEMTOT */
+        /* option_kind == CGDBRC_REFRESHRATE */
         /* option_kind == CGDBRC_SHOWTGDBCOMMANDS */
         /* option_kind == CGDBRC_TABSTOP */
         /* option_kind == CGDBRC_TIMEOUT */
         /* option_kind == CGDBRC_TIMEOUTLEN */
         /* option_kind == CGDBRC_TTIMEOUT */
         /* option_kind == CGDBRC_TTIMEOUTLEN */
+        /* option_kind == CGDBRC_TTYSCROLLBACK */
         /* option_kind == CGDBRC_WINMINHEIGHT */
         /* option_kind == CGDBRC_WRAPSCAN */
         int int_val;
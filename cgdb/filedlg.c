@@ -29,7 +29,8 @@
 struct file_buffer {
     int length;                 /* Number of files in program */
     char **files;               /* Array containing file */
-    char *cur_line;             /* cur line may have unique color */
+    int match_beg;              /* A search match on the selected line, */
+    int match_end;              /* which is -1 to -1 if there is none */
     int max_width;              /* Width of longest line in file */
 
     int sel_line;               /* Current line selected in file dialog */
@@ -43,8 +44,12 @@ struct file_buffer {
 struct filedlg {
     struct file_buffer *buf;    /* All of the widget's data ( files ) */
     WINDOW *win;                /* Curses window */
+    char *label;                /* The line above the list, or NULL */
 };
 
+/* The label when the dialog lists source files */
+static char *filedlg_label = "Select a file or press q to cancel.";
+
 static char regex_line[MAX_LINE];   /* The regex the user enters */
 static int regex_line_pos;      /* The index into the current regex */
 static int regex_search;        /* Currently searching text ? */
@@ -88,6 +93,7 @@ struct filedlg *filedlg_new(int pos_r, int pos_c, int height, int width)
 
     /* Initialize the structure */
     fd->win = newwin(height, width, pos_r, pos_c);
+    fd->label = NULL;
     keypad(fd->win, TRUE);
 
     /* Initialize the buffer */
@@ -96,7 +102,8 @@ struct filedlg *filedlg_new(int pos_r, int pos_c, int height, int width)
 
     fd->buf->length = 0;
     fd->buf->files = NULL;
-    fd->buf->cur_line = NULL;
+    fd->buf->match_beg = -1;
+    fd->buf->match_end = -1;
     fd->buf->max_width = 0;
     fd->buf->sel_line = 0;
     fd->buf->sel_col = 0;
@@ -110,6 +117,7 @@ struct filedlg *filedlg_new(int pos_r, int pos_c, int height, int width)
 void filedlg_free(struct filedlg *fdlg)
 {
     filedlg_clear(fdlg);
+    free(fdlg->label);
     delwin(fdlg->win);
     free(fdlg->buf);
     free(fdlg);
@@ -174,6 +182,36 @@ int filedlg_add_file_choice(struct filedlg *fd, const char *file_choice)
     return 0;
 }
 
+int filedlg_add_choice(struct filedlg *fd, const char *choice)
+{
+    int length;
+
+    if (choice == NULL)
+        return -1;
+
+    fd->buf->files = realloc(fd->buf->files,
+            sizeof (char *) * (fd->buf->length + 1));
+    if ((fd->buf->files[fd->buf->length] = strdup(choice)) == NULL)
+        return -2;
+    fd->buf->length++;
+
+    if ((length = strlen(choice)) > fd->buf->max_width)
+        fd->buf->max_width = length;
+
+    return 0;
+}
+
+void filedlg_set_label(struct filedlg *fd, const char *label)
+{
+    free(fd->label);
+    fd->label = label ? strdup(label) : NULL;
+}
+
+int filedlg_get_selection(struct filedlg *fd)
+{
+    return fd->buf->sel_line;
+}
+
 void filedlg_clear(struct filedlg *fd)
 {
     int i;
@@ -184,8 +222,8 @@ void filedlg_clear(struct filedlg *fd)
     free(fd->buf->files);
     fd->buf->files = NULL;
 
-    free(fd->buf->cur_line);
-    fd->buf->cur_line = NULL;
+    fd->buf->match_beg = -1;
+    fd->buf->match_end = -1;
 
     fd->buf->max_width = 0;
     fd->buf->length = 0;
@@ -194,6 +232,8 @@ void filedlg_clear(struct filedlg *fd)
     fd->buf->sel_col_rbeg = 0;
     fd->buf->sel_col_rend = 0;
     fd->buf->sel_rline = 0;
+
+    hl_regex_forget(fd->buf);
 }
 
 static void filedlg_vscroll(struct filedlg *fd, int offset)
@@ -230,6 +270,8 @@ static void filedlg_search_regex_init(struct filedlg *fd)
     if (fd == NULL || fd->buf == NULL)
         return;
 
+    hl_regex_forget(fd->buf);
+
     /* Start from beggining of line if not at same line */
     if (fd->buf->sel_rline != fd->buf->sel_line) {
         fd->buf->sel_col_rend = 0;
@@ -240,18 +282,21 @@ static void filedlg_search_regex_init(struct filedlg *fd)
     fd->buf->sel_rline = fd->buf->sel_line;
 }
 
+/* filedlg_get_line: Gets a file name for hl_regex to search. */
+static const char *filedlg_get_line(void *data, int line)
+{
+    return ((struct file_buffer *) data)->files[line];
+}
+
 static int filedlg_search_regex(struct filedlg *fd, const char *regex,
         int opt, int direction, int icase)
 {
     if (fd == NULL || fd->buf == NULL || regex == NULL || strlen(regex) == 0)
         return -1;
 
-    return hl_regex(regex,
-            (const char **) fd->buf->files,
-            (const char **) fd->buf->files,
-            fd->buf->length,
-            &fd->buf->cur_line, &fd->buf->sel_line,
-            &fd->buf->sel_rline, &fd->buf->sel_col_rbeg,
+    return hl_regex(regex, filedlg_get_line, fd->buf, fd->buf->files,
+            fd->buf->length, &fd->buf->match_beg, &fd->buf->match_end,
+            &fd->buf->sel_line, &fd->buf->sel_rline, &fd->buf->sel_col_rbeg,
             &fd->buf->sel_col_rend, opt, direction, icase);
 }
 
@@ -263,7 +308,7 @@ int filedlg_display(struct filedlg *fd)
     int file;
     int i;
     int attr;
-    static char *label = "Select a file or press q to cancel.";
+    char *label = fd->label ? fd->label : filedlg_label;
 
     curs_set(0);
 
@@ -326,12 +371,9 @@ int filedlg_display(struct filedlg *fd)
                 waddch(fd->win, '-');
                 waddch(fd->win, '>');
                 wattroff(fd->win, attr);
-                if (fd->buf->cur_line != NULL)
-                    hl_wprintw(fd->win, fd->buf->cur_line, width - lwidth - 2,
-                            fd->buf->sel_col);
-                else
-                    hl_wprintw(fd->win, fd->buf->files[file],
-                            width - lwidth - 2, fd->buf->sel_col);
+                hl_wprintw(fd->win, fd->buf->files[file], NULL, NULL,
+                        width - lwidth - 2, fd->buf->sel_col,
+                        fd->buf->match_beg, fd->buf->match_end);
             }
             /* Ordinary file */
             else {
@@ -342,12 +384,8 @@ int filedlg_display(struct filedlg *fd)
                 waddch(fd->win, ' ');
 
                 /* No special file information */
-                if (file == fd->buf->sel_line && fd->buf->cur_line != NULL)
-                    hl_wprintw(fd->win, fd->buf->cur_line, width - lwidth - 2,
-                            fd->buf->sel_col);
-                else
-                    hl_wprintw(fd->win, fd->buf->files[file],
-                            width - lwidth - 2, fd->buf->sel_col);
+                hl_wprintw(fd->win, fd->buf->files[file], NULL, NULL,
+                        width - lwidth - 2, fd->buf->sel_col, -1, -1);
             }
         } else {
             wprintw(fd->win, "%s\n", fd->buf->files[file]);
@@ -526,7 +564,8 @@ int filedlg_recv_char(struct filedlg *fd, int key, char *file)
         case '\n':
         case '\r':
         case CGDB_KEY_CTRL_M:
-            strcpy(file, fd->buf->files[fd->buf->sel_line]);
+            snprintf(file, MAX_LINE, "%s",
+                    fd->buf->files[fd->buf->sel_line]);
             return 1;
         default:
             break;
@@ -31,6 +31,32 @@ void filedlg_free(struct filedlg *fdlg);
  */
 int filedlg_add_file_choice(struct filedlg *fd, const char *file_choice);
 
+/* filedlg_add_choice:  Add a line to the end of the list, as it is.
+ * -------------------
+ *
+ * Unlike filedlg_add_file_choice, the lines are not sorted, and the same
+ * line can be added more than once.
+ *
+ * choice: The line the user will be able to choose.
+ *
+ * Return Value:  Zero on success, non-zero on error.
+ */
+int filedlg_add_choice(struct filedlg *fd, const char *choice);
+
+/* filedlg_set_label:  Sets the line shown above the list.
+ * ------------------
+ *
+ * label: The line, or NULL to ask the user to select a file.
+ */
+void filedlg_set_label(struct filedlg *fd, const char *label);
+
+/* filedlg_get_selection:  Gets the line the user is on.
+ * ----------------------
+ *
+ * Return Value:  The index of the line, in the order they were added.
+ */
+int filedlg_get_selection(struct filedlg *fd);
+
 /* filedlg_clear: Clears all the file_choice's in the dialog.
  * ______________
  */
@@ -40,7 +66,7 @@ void filedlg_clear(struct filedlg *fd);
  *
  *   fdlg:  The file dialog to free.
  *   key :  The next key of input to process
- *   file:  The file the user selected
+ *   file:  The file the user selected, MAX_LINE characters long
  *
  *  returns -1 when aborted by user.
  *  returns 0 when needs more input
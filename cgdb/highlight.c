@@ -14,279 +14,1958 @@
 #include <ctype.h>
 #endif /* HAVE_CTYPE_H */
 
+#if HAVE_STDIO_H
+#include <stdio.h>
+#endif /* HAVE_STDIO_H */
+
 #if HAVE_LIMITS_H
-#include <limits.h>             /* CHAR_MAX */
+#include <limits.h>             /* USHRT_MAX */
 #endif /* HAVE_LIMITS_H */
 
-#if HAVE_STRING_H
-#include <string.h>
-#endif /* HAVE_STRING_H */
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif /* HAVE_SYS_TYPES_H */
+
+#if HAVE_REGEX_H
+#include <regex.h>
+#endif /* HAVE_REGEX_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif /* HAVE_FCNTL_H */
+
+#if HAVE_SIGNAL_H
+#include <signal.h>
+#endif /* HAVE_SIGNAL_H */
+
+#if HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif /* HAVE_SYS_STAT_H */
+
+#if HAVE_DIRENT_H
+#include <dirent.h>
+#endif /* HAVE_DIRENT_H */
+
+#if HAVE_UTIME_H
+#include <utime.h>
+#endif /* HAVE_UTIME_H */
+
+#if HAVE_PTHREAD_H && HAVE_LIBPTHREAD
+#include <pthread.h>
+#define HL_WORKER 1
+#endif /* HAVE_PTHREAD_H && HAVE_LIBPTHREAD */
+
+/* Local Includes */
+#include "highlight.h"
+#include "highlight_groups.h"
+#include "sources.h"
+#include "cgdb.h"
+#include "tokenizer.h"
+#include "interface.h"
+#include "sys_util.h"
+#include "fs_util.h"
+#include "std_hash.h"
+#include "logger.h"
+#include "search.h"
+
+/* ----------- */
+/* Definitions */
+/* ----------- */
+
+/* Lexer states are remembered at the start of every HL_CHECKPOINT_LINES'th
+ * line, so highlighting can start from there instead of at the top of the
+ * file. */
+#define HL_CHECKPOINT_LINES 128
+
+/* How far in front of the lines being highlighted a checkpoint or the start
+ * of a comment is looked for.  This bounds the work done to highlight any
+ * part of a file. */
+#define HL_SYNC_LINES 512
+
+/* The most lines lexed again when a file is reloaded. The rest of a file
+ * that changed more than this is highlighted again as it is displayed. */
+#define HL_RELOAD_LINES 4096
+
+/* Highlighted files are cached on disk, in a directory in the cgdb home
+ * directory.  When the cache grows over HL_CACHE_SIZE bytes, the files used
+ * least recently are removed.  Files too large for a fair share of it are
+ * not cached at all. */
+#define HL_CACHE_DIR "hl_cache"
+#define HL_CACHE_SIZE (32 * 1024 * 1024)
+#define HL_CACHE_FILE_SIZE (HL_CACHE_SIZE / 4)
+
+/* Change this when the format of the spans changes, for example when
+ * highlight groups are added. Changes to a lexer are caught by the lexer
+ * version in the header instead, see tokenizer_get_version. */
+#define HL_CACHE_MAGIC "CGDBHL4"
+
+/* The start of a cache file. It is followed by the path of the source file,
+ * and the spans of each line: the number of spans, and then the spans
+ * including the last one, of length 0. */
+struct hl_cache_header {
+    char magic[8];
+    char lexer[24];             /* The version of the lexer that was used */
+    long long size;             /* The size of the source file */
+    long long mtime;            /* The modification time of the source file */
+    int language;               /* The language it was highlighted as */
+    int length;                 /* The number of lines */
+    int path_length;            /* The length of the path, without a NUL */
+    int data_size;              /* The size of the spans */
+};
+
+/* --------------- */
+/* Local Functions */
+/* --------------- */
+
+/* hl_plain: Checks to see if the lines of a file are displayed without
+ * --------- syntax highlighting.
+ */
+static int hl_plain(struct list_node *node)
+{
+    return node->language == TOKENIZER_LANGUAGE_UNKNOWN || !has_colors();
+}
+
+/* The spans of lines that have no highlighted text and end in the initial
+ * lexer state, guessed and exact. These are shared, to save an allocation
+ * for each of those lines. */
+static struct hl_span hl_no_spans[2] = { {0, 0, 0}, {0, 0, 1} };
+
+/* hl_spans_shared: Checks to see if spans are one of hl_no_spans. */
+static int hl_spans_shared(const struct hl_span *spans)
+{
+    return spans == &hl_no_spans[0] || spans == &hl_no_spans[1];
+}
+
+/* hl_spans_count: Counts the spans of a line, not including the last one. */
+static int hl_spans_count(const struct hl_span *spans)
+{
+    int count = 0;
+
+    while (spans[count].length)
+        count++;
+
+    return count;
+}
+
+/* hl_spans_end: Gets the last span of a line, which holds the lexer state
+ * ------------- at the end of the line.
+ */
+static const struct hl_span *hl_spans_end(const struct hl_span *spans)
+{
+    return &spans[hl_spans_count(spans)];
+}
+
+/* hl_spans_size: Gets the number of bytes allocated for spans. */
+static long hl_spans_size(struct hl_span *spans)
+{
+    if (!spans || hl_spans_shared(spans))
+        return 0;
+
+    return sizeof (struct hl_span) * (hl_spans_count(spans) + 1);
+}
+
+/* hl_spans_free: Frees the spans of a line. */
+static void hl_spans_free(struct hl_span *spans)
+{
+    if (!hl_spans_shared(spans))
+        free(spans);
+}
+
+/* hl_spans_new: Makes the spans of a line.
+ * -------------
+ *
+ *   spans: The spans, which are copied
+ *   count: The number of spans
+ *   state: The state of the lexer at the end of the line
+ *   exact: If the state is exact, or a guess
+ *
+ * Return Value: The spans, with a span of length 0 added at the end.
+ */
+static struct hl_span *hl_spans_new(const struct hl_span *spans, int count,
+        int state, int exact)
+{
+    struct hl_span *result;
+
+    if (count == 0 && state == 0)
+        return &hl_no_spans[exact ? 1 : 0];
+
+    result = cgdb_malloc(sizeof (struct hl_span) * (count + 1));
+    memcpy(result, spans, sizeof (struct hl_span) * count);
+    result[count].start = state;
+    result[count].length = 0;
+    result[count].group = exact ? 1 : 0;
+
+    return result;
+}
+
+/* hl_add_span: Adds a span for a token to the spans of a line.
+ * ------------
+ *
+ * Tokens of the same group that follow each other share a span, as long as
+ * it does not get too long for its length.
+ *
+ *   spans:    The spans of the line so far, grown as needed
+ *   count:    The number of spans
+ *   capacity: The number of spans allocated
+ *   start:    The offset of the token in the line
+ *   length:   The length of the token
+ *   group:    The group to draw the token in
+ */
+static void hl_add_span(struct hl_span **spans, int *count, int *capacity,
+        int start, int length, enum hl_group_kind group)
+{
+    struct hl_span *last;
+    int n;
+
+    while (length > 0) {
+        last = *count ? &(*spans)[*count - 1] : NULL;
+
+        if (last && last->group == group &&
+                last->start + last->length == start &&
+                last->length < USHRT_MAX) {
+            n = USHRT_MAX - last->length;
+            n = length < n ? length : n;
+            last->length += n;
+        } else {
+            if (*count == *capacity) {
+                *capacity = *capacity ? *capacity * 2 : 16;
+                *spans = cgdb_realloc(*spans,
+                        sizeof (struct hl_span) * *capacity);
+            }
+
+            n = length < USHRT_MAX ? length : USHRT_MAX;
+            (*spans)[*count].start = start;
+            (*spans)[*count].length = n;
+            (*spans)[*count].group = group;
+            (*count)++;
+        }
+
+        start += n;
+        length -= n;
+    }
+}
+
+/* hl_set_checkpoint: Remembers the lexer state at the start of a line.
+ * ------------------
+ *
+ * A state that was guessed never replaces one that is exact.
+ */
+static void hl_set_checkpoint(struct list_node *node, int line, int state,
+        int exact)
+{
+    struct hl_checkpoint *cp;
+
+    if (line % HL_CHECKPOINT_LINES != 0 || line >= node->buf.length)
+        return;
+
+    cp = &node->hl_checkpoints[line / HL_CHECKPOINT_LINES];
+    if (exact || cp->known != HL_STATE_EXACT) {
+        cp->state = state;
+        cp->known = exact ? HL_STATE_EXACT : HL_STATE_GUESSED;
+    }
+}
+
+/* hl_sync_line: Looks for the start or end of a comment in a line.
+ * -------------
+ *
+ * The line is searched from the end, so the last one found is reported.
+ *
+ *   text:  The line
+ *   len:   The length of the line
+ *
+ * Return Value: 1 if the start of a comment is found, 0 if the end of a
+ *               comment is found, -1 if neither is found.
+ */
+static int hl_sync_line(const char *text, int len)
+{
+    int j;
+
+    for (j = len - 1; j > 0; j--) {
+        if (text[j - 1] == '*' && text[j] == '/')
+            return 0;
+
+        if (text[j - 1] == '/' && text[j] == '*')
+            return 1;
+    }
+
+    return -1;
+}
+
+/* hl_sync: Finds a line to start lexing at, when nothing is known about
+ * -------- the state of the lexer near the lines to highlight.
+ *
+ * Like the ccomment method of vim, the lines in front of the given line are
+ * searched for the start or end of a comment.  If the start of a comment is
+ * found first, lexing starts at the line it is on, so the lexer sees the
+ * comment begin.  Otherwise the line itself is assumed to start outside of
+ * a comment.
+ *
+ *   language:  The language of the file
+ *   lines:     The text of the lines of the file
+ *   lens:      The length of each line, or NULL if lines are NUL terminated
+ *   line:      The first line to highlight
+ *
+ * Return Value: The line to start lexing at, in the initial lexer state.
+ */
+static int hl_sync(enum tokenizer_language_support language,
+        const char **lines, const int *lens, int line)
+{
+    int i, found;
+
+    /* Ada only has comments which end with the line */
+    if (language == TOKENIZER_LANGUAGE_ADA)
+        return line;
+
+    for (i = line - 1; i >= 0 && i >= line - HL_SYNC_LINES; i--) {
+        found = hl_sync_line(lines[i], lens ? lens[i] : strlen(lines[i]));
+
+        if (found == 0)
+            return line;
+
+        if (found == 1)
+            return i;
+    }
+
+    return line;
+}
+
+#if HL_WORKER
+/* The lexers keep their state in globals, so only one thread may use them
+ * at a time. */
+static pthread_mutex_t hl_lexer_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif /* HL_WORKER */
+
+/* hl_lex_text: Highlights lines of text by running them through the lexer.
+ * ------------
+ *
+ * This does not touch any list_node, so it can be called from any thread.
+ *
+ *   text:     The lines, each ending in a newline
+ *   size:     The size of text in bytes
+ *   count:    The number of lines in text
+ *   language: The language of the text
+ *   state:    The state of the lexer at the start of the text
+ *   exact:    If the state is exact, or a guess
+ *   spans:    Returns the spans of each line, which must be freed. Lines the
+ *             lexer did not get to are NULL.
+ *   states:   Returns the state of the lexer at the start of each line, and
+ *             after the last one, or -1 where it is not known. This has
+ *             count + 1 entries.
+ *
+ * Return Value: Zero on success, or -1 on error.
+ */
+static int hl_lex_text(const char *text, int size, int count,
+        enum tokenizer_language_support language, int state, int exact,
+        struct hl_span **spans, int *states)
+{
+    struct tokenizer *t;
+    struct hl_span *line_spans = NULL;
+    int line_count = 0, capacity = 0;
+    int line = 0, col = 0;
+    int result = 0;
+
+    memset(spans, 0, sizeof (struct hl_span *) * count);
+    states[0] = state;
+
+#if HL_WORKER
+    pthread_mutex_lock(&hl_lexer_mutex);
+#endif /* HL_WORKER */
+
+    t = tokenizer_init();
+
+    if (tokenizer_set_buffer(t, text, size, language, state) == -1) {
+        result = -1;
+        line = count;
+    }
+
+    while (line < count && tokenizer_get_token(t) > 0) {
+        enum tokenizer_type e = tokenizer_get_packet_type(t);
+        const char *data = tokenizer_get_data(t);
+        int length = strlen(data);
+        enum hl_group_kind group = HLG_TEXT;
+
+        switch (e) {
+            case TOKENIZER_KEYWORD:
+                group = HLG_KEYWORD;
+                break;
+            case TOKENIZER_TYPE:
+                group = HLG_TYPE;
+                break;
+            case TOKENIZER_LITERAL:
+                group = HLG_LITERAL;
+                break;
+            case TOKENIZER_COMMENT:
+                group = HLG_COMMENT;
+                break;
+            case TOKENIZER_DIRECTIVE:
+                group = HLG_DIRECTIVE;
+                break;
+            case TOKENIZER_NUMBER:
+            case TOKENIZER_TEXT:
+            case TOKENIZER_ERROR:
+                break;
+            case TOKENIZER_NEWLINE:
+                /* Lines are only split at a newline. A carriage return
+                 * inside of a line is part of the line. */
+                if (data[length - 1] != '\n') {
+                    col += length;
+                    continue;
+                }
+
+                states[line + 1] = tokenizer_get_state(t);
+                spans[line] = hl_spans_new(line_spans, line_count,
+                        states[line + 1], exact);
+                line++;
+
+                line_count = 0;
+                col = 0;
+                continue;
+        }
+
+        if (group != HLG_TEXT)
+            hl_add_span(&line_spans, &line_count, &capacity, col, length,
+                    group);
+        col += length;
+    }
+
+    tokenizer_destroy(t);
+
+#if HL_WORKER
+    pthread_mutex_unlock(&hl_lexer_mutex);
+#endif /* HL_WORKER */
+
+    free(line_spans);
+
+    /* The state after lines the lexer did not get to is not known */
+    for (line++; line <= count; line++)
+        states[line] = -1;
+
+    return result;
+}
+
+/* hl_install: Stores the spans of highlighted lines in a file.
+ * -----------
+ *
+ *   node:   The file the lines belong to
+ *   start:  The line number of the first line
+ *   count:  The number of lines
+ *   spans:  The spans of each line, which the file takes ownership of
+ *   states: The lexer state at the start of each line, count + 1 entries
+ *   exact:  If the lines were lexed from an exact state. These replace lines
+ *           that were guessed.
+ *
+ * Return Value: The change in the number of bytes used by the file.
+ */
+static long hl_install(struct list_node *node, int start, int count,
+        struct hl_span **spans, int *states, int exact)
+{
+    long bytes = 0;
+    int i;
+
+    for (i = 0; i <= count && start + i < node->buf.length; i++) {
+        if (states[i] != -1)
+            hl_set_checkpoint(node, start + i, states[i], exact);
+
+        if (i == count || !spans[i])
+            continue;
+
+        if (node->hl_spans[start + i]) {
+            if (!exact) {
+                hl_spans_free(spans[i]);
+                continue;
+            }
+
+            bytes -= hl_spans_size(node->hl_spans[start + i]);
+            hl_spans_free(node->hl_spans[start + i]);
+        }
+
+        node->hl_spans[start + i] = spans[i];
+        bytes += hl_spans_size(spans[i]);
+    }
+
+    /* Lines past the end of the buffer */
+    for (; i < count; i++)
+        if (spans[i])
+            hl_spans_free(spans[i]);
+
+    return bytes;
+}
+
+/* hl_lex_lines: Runs a range of lines of a file through the lexer.
+ * -------------
+ *
+ *   node:   The file being highlighted
+ *   from:   The first line to lex
+ *   end:    One past the last line to lex
+ *   state:  The state of the lexer at the start of line from
+ *   exact:  If the state is known to be right, or only a guess
+ *   spans:  Returns the spans of each line, see hl_lex_text
+ *   states: Returns the lexer state at the start of each line, see
+ *           hl_lex_text
+ */
+static void hl_lex_lines(struct list_node *node, int from, int end,
+        int state, int exact, struct hl_span **spans, int *states)
+{
+    struct ibuf *text = ibuf_init();
+    int i;
+
+    for (i = from; i < end; i++) {
+        ibuf_add(text, node->buf.tlines[i]);
+        ibuf_addchar(text, '\n');
+    }
+
+    if (hl_lex_text(ibuf_get(text), ibuf_length(text), end - from,
+                    node->language, state, exact, spans, states) == -1)
+        if_print_message("%s:%d tokenizer_set_buffer error",
+                __FILE__, __LINE__);
+
+    ibuf_free(text);
+}
+
+/* hl_lex: Highlights a range of lines by running them through the lexer.
+ * -------
+ *
+ *   node:  The file being highlighted
+ *   from:  The first line to lex
+ *   end:   One past the last line to lex
+ *   state: The state of the lexer at the start of line from
+ *   exact: If the state is known to be right, or only a guess. Lines lexed
+ *          from an exact state replace lines that were guessed.
+ *
+ * Return Value: The change in the number of bytes used by the file.
+ */
+static long hl_lex(struct list_node *node, int from, int end, int state,
+        int exact)
+{
+    int count = end - from;
+    struct hl_span **spans = cgdb_malloc(sizeof (struct hl_span *) * count);
+    int *states = cgdb_malloc(sizeof (int) * (count + 1));
+    long bytes;
+
+    hl_lex_lines(node, from, end, state, exact, spans, states);
+    bytes = hl_install(node, from, count, spans, states, exact);
+
+    free(spans);
+    free(states);
+
+    return bytes;
+}
+
+/* hl_missing: Finds the lines in a range that are not highlighted yet.
+ * -----------
+ *
+ *   node:  The file being highlighted
+ *   start: The first line of the range, returns the first missing line
+ *   end:   One past the last line of the range, returns one past the last
+ *          missing line
+ *
+ * Return Value: 1 if lines are missing, 0 otherwise.
+ */
+static int hl_missing(struct list_node *node, int *start, int *end)
+{
+    int first = -1, last = -1;
+    int i;
+
+    if (*start < 0)
+        *start = 0;
+    if (*end > node->buf.length)
+        *end = node->buf.length;
+
+    for (i = *start; i < *end; i++) {
+        if (!node->hl_spans[i]) {
+            if (first == -1)
+                first = i;
+            last = i;
+        }
+    }
+
+    if (first == -1)
+        return 0;
+
+    *start = first;
+    *end = last + 1;
+
+    return 1;
+}
+
+/* hl_lines_free: Frees the spans of the lines of a file. */
+static void hl_lines_free(struct hl_span **spans, int length)
+{
+    int i;
+
+    if (!spans)
+        return;
+
+    for (i = 0; i < length; i++)
+        if (spans[i])
+            hl_spans_free(spans[i]);
+    free(spans);
+}
+
+/* hl_alloc: Sets up a file for highlighting, with no lines highlighted. */
+static void hl_alloc(struct list_node *node)
+{
+    static unsigned long generation = 0;
+
+    node->hl_generation = ++generation;
+
+    if (node->buf.length == 0)
+        return;
+
+    node->hl_spans = cgdb_calloc(node->buf.length, sizeof (struct hl_span *));
+    node->hl_checkpoints =
+            cgdb_calloc(node->buf.length / HL_CHECKPOINT_LINES + 1,
+            sizeof (struct hl_checkpoint));
+
+    /* The top of the file always starts in the initial state */
+    node->hl_checkpoints[0].state = 0;
+    node->hl_checkpoints[0].known = HL_STATE_EXACT;
+}
+
+/* hl_dirty: Checks to see if the lexer has to start over at a line of a
+ * ---------  reloaded file. This is so if the line changed, or if lines in
+ *            front of it were removed.
+ *
+ *   new_to_old: See highlight_reload
+ *   line:       The line of the reloaded file
+ */
+static int hl_dirty(const int *new_to_old, int line)
+{
+    if (new_to_old[line] == -1)
+        return 1;
+
+    if (line == 0)
+        return new_to_old[line] != 0;
+
+    return new_to_old[line - 1] != -1 &&
+            new_to_old[line] != new_to_old[line - 1] + 1;
+}
+
+/* hl_exact_start: Finds the closest line at or in front of a line that the
+ * ---------------  lexer state is exactly known at the start of.
+ *
+ *   node:  The file
+ *   line:  The line
+ *   state: Returns the lexer state at the start of the line found
+ *
+ * Return Value: The line found, or -1 if there is none within
+ *               HL_SYNC_LINES lines.
+ */
+static int hl_exact_start(struct list_node *node, int line, int *state)
+{
+    const struct hl_span *last;
+    int i;
+
+    for (i = line; i > 0 && i >= line - HL_SYNC_LINES; i--) {
+        if (!node->hl_spans[i - 1])
+            continue;
+
+        last = hl_spans_end(node->hl_spans[i - 1]);
+        if (last->group) {
+            *state = last->start;
+            return i;
+        }
+    }
+
+    if (i != 0)
+        return -1;
+
+    *state = 0;
+    return 0;
+}
+
+/* hl_drop: Forgets the highlighting of the lines from a line to the end. */
+static void hl_drop(struct list_node *node, int from)
+{
+    int i;
+
+    for (i = from; i < node->buf.length; i++) {
+        if (node->hl_spans[i]) {
+            hl_spans_free(node->hl_spans[i]);
+            node->hl_spans[i] = NULL;
+        }
+    }
+}
+
+/* hl_relex: Highlights the parts of a reloaded file that changed.
+ * ---------
+ *
+ * Each change is lexed from the closest exact lexer state in front of it,
+ * and on past it until the lexer is in the same state at the start of an
+ * unchanged line as it was before the reload. The spans of the lines from
+ * there on are still right. When that does not happen soon, and the lines
+ * that follow were not highlighted before, or when too much of the file
+ * changed, the rest of the file is highlighted again as it is displayed.
+ *
+ *   node:       The reloaded file, with the spans of the unchanged lines
+ *   new_to_old: See highlight_reload
+ *   old_states: The lexer state at the start of each line before the
+ *               reload, or -1 where it is not known exactly
+ */
+static void hl_relex(struct list_node *node, const int *new_to_old,
+        const int *old_states)
+{
+    int length = node->buf.length;
+    int line = 0, lexed = 0, from, end, to, count, state, i, synced;
+    struct hl_span **spans;
+    int *states;
+
+    while (line < length) {
+        if (!hl_dirty(new_to_old, line)) {
+            line++;
+            continue;
+        }
+
+        from = hl_exact_start(node, line, &state);
+        if (from == -1) {
+            hl_drop(node, line);
+            return;
+        }
+
+        for (end = line; end < length && new_to_old[end] == -1; end++);
+
+        synced = -1;
+        while (synced == -1 && from < length) {
+            /* The lines that follow were not highlighted before, so the
+             * lexer can not be checked against them */
+            if (lexed > HL_RELOAD_LINES ||
+                    (from > end + HL_SYNC_LINES && old_states[from] == -1)) {
+                hl_drop(node, from);
+                return;
+            }
+
+            to = from + HL_CHECKPOINT_LINES;
+            if (to > length)
+                to = length;
+            count = to - from;
+            lexed += count;
+
+            spans = cgdb_malloc(sizeof (struct hl_span *) * count);
+            states = cgdb_malloc(sizeof (int) * (count + 1));
+            hl_lex_lines(node, from, to, state, 1, spans, states);
+
+            for (i = end > from ? end : from; i < to && synced == -1; i++)
+                if (old_states[i] != -1 && states[i - from] == old_states[i])
+                    synced = i;
+
+            /* The old spans are kept from the line the lexer synced at */
+            count = synced == -1 ? count : synced - from;
+            for (i = count; i < to - from; i++)
+                if (spans[i])
+                    hl_spans_free(spans[i]);
+            hl_install(node, from, count, spans, states, 1);
+
+            state = states[count];
+            free(spans);
+            free(states);
+
+            if (synced == -1 && state == -1) {
+                hl_drop(node, from);
+                return;
+            }
+
+            from = to;
+        }
+
+        line = synced == -1 ? length : synced + 1;
+    }
+}
+
+/* --------------- */
+/* Highlight cache */
+/* --------------- */
+
+/* The directory for cache files, or empty if there is none */
+static char hl_cache_dir[FSUTIL_PATH_MAX];
+
+/* hl_cache_file: Gets the name of the cache file of a source file. */
+static void hl_cache_file(struct list_node *node, char *file)
+{
+    char name[32];
+
+    sprintf(name, "%08x.hl", std_str_hash(node->path));
+    fs_util_get_path(hl_cache_dir, name, file);
+}
+
+/* hl_cache_header: Fills in the cache header of a file. */
+static void hl_cache_header(struct list_node *node,
+        struct hl_cache_header *header, int data_size)
+{
+    memset(header, 0, sizeof (struct hl_cache_header));
+    memcpy(header->magic, HL_CACHE_MAGIC, sizeof (header->magic));
+    strncpy(header->lexer, tokenizer_get_version(node->language),
+            sizeof (header->lexer) - 1);
+    header->size = node->buf.text_size;
+    header->mtime = node->last_modification;
+    header->language = node->language;
+    header->length = node->buf.length;
+    header->path_length = strlen(node->path);
+    header->data_size = data_size;
+}
+
+/* hl_cache_read: Reads and checks the contents of a cache file.
+ * --------------
+ *
+ *   node:  The file the cache file should be for
+ *   fp:    The open cache file
+ *
+ * Return Value: The spans of the lines, one line after the other, or NULL
+ *               if the cache file is not valid for the file.  This must be
+ *               freed.
+ */
+static char *hl_cache_read(struct list_node *node, FILE *fp)
+{
+    struct hl_cache_header header, expected;
+    struct stat st;
+    char *data, *pos, *end;
+    int i, count;
+
+    if (fstat(fileno(fp), &st) == -1 ||
+            fread(&header, sizeof (header), 1, fp) != 1)
+        return NULL;
+
+    /* The spans are checked against the size of the cache file instead */
+    hl_cache_header(node, &expected, header.data_size);
+    if (memcmp(&header, &expected, sizeof (header)) != 0 ||
+            header.data_size <= 0 || st.st_size != sizeof (header) +
+            header.path_length + (long long) header.data_size)
+        return NULL;
+
+    data = cgdb_malloc(header.path_length + header.data_size);
+    if (fread(data, header.path_length + header.data_size, 1, fp) != 1 ||
+            strncmp(data, node->path, header.path_length) != 0) {
+        free(data);
+        return NULL;
+    }
+
+    /* Check that it holds the right number of lines, and that the lexer
+     * states are ones the lexer can start in */
+    memmove(data, data + header.path_length, header.data_size);
+    pos = data;
+    end = data + header.data_size;
+    for (i = 0; i < header.length && end - pos >= sizeof (int); i++) {
+        struct hl_span last;
+
+        memcpy(&count, pos, sizeof (int));
+        pos += sizeof (int);
+        if (count < 0 || count >= (end - pos) / sizeof (struct hl_span) + 1)
+            break;
+        memcpy(&last, pos + count * sizeof (struct hl_span),
+                sizeof (struct hl_span));
+        if (!tokenizer_state_valid(node->language, last.start))
+            break;
+        pos += (count + 1) * sizeof (struct hl_span);
+    }
+
+    if (i != header.length || pos != end) {
+        free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+/* hl_cache_load: Loads the spans of a file from the cache.
+ * --------------
+ *
+ * The cache file is only used if the source file has not changed since it
+ * was written.
+ *
+ *   node:  The file, with hl_spans allocated and empty
+ *
+ * Return Value: 1 if the spans were loaded, 0 otherwise.
+ */
+static int hl_cache_load(struct list_node *node)
+{
+    char file[FSUTIL_PATH_MAX];
+    FILE *fp;
+    char *data, *pos;
+    int i, count;
+
+    if (!hl_cache_dir[0])
+        return 0;
+
+    hl_cache_file(node, file);
+    fp = fopen(file, "rb");
+    if (!fp)
+        return 0;
+
+    data = hl_cache_read(node, fp);
+    fclose(fp);
+
+    if (!data)
+        return 0;
+
+    for (pos = data, i = 0; i < node->buf.length; i++) {
+        struct hl_span *spans;
+
+        memcpy(&count, pos, sizeof (int));
+        spans = (struct hl_span *) (pos + sizeof (int));
+        node->hl_spans[i] = hl_spans_new(spans, count, spans[count].start,
+                spans[count].group);
+        pos += sizeof (int) + (count + 1) * sizeof (struct hl_span);
+    }
+
+    free(data);
+
+    /* Mark it as used, so it is removed from the cache last */
+#if HAVE_UTIME_H
+    utime(file, NULL);
+#endif /* HAVE_UTIME_H */
+
+    return 1;
+}
+
+/* hl_cache_entry: A file in the cache directory */
+struct hl_cache_entry {
+    char *name;
+    off_t size;
+    time_t mtime;
+};
+
+/* hl_cache_entry_compare: Orders cache files from least recently used. */
+static int hl_cache_entry_compare(const void *a, const void *b)
+{
+    const struct hl_cache_entry *ea = a, *eb = b;
+
+    if (ea->mtime != eb->mtime)
+        return ea->mtime < eb->mtime ? -1 : 1;
+
+    return 0;
+}
+
+/* hl_cache_trim: Removes the least recently used files from the cache until
+ * --------------  it fits in HL_CACHE_SIZE bytes.
+ */
+static void hl_cache_trim(void)
+{
+#if HAVE_DIRENT_H
+    DIR *dir;
+    struct dirent *ent;
+    struct hl_cache_entry *entries = NULL;
+    int count = 0, i;
+    long long total = 0;
+    char file[FSUTIL_PATH_MAX];
+    struct stat st;
+
+    dir = opendir(hl_cache_dir);
+    if (!dir)
+        return;
+
+    while ((ent = readdir(dir))) {
+        if (ent->d_name[0] == '.')
+            continue;
+
+        fs_util_get_path(hl_cache_dir, ent->d_name, file);
+        if (stat(file, &st) == -1 || !S_ISREG(st.st_mode))
+            continue;
+
+        entries = cgdb_realloc(entries,
+                sizeof (struct hl_cache_entry) * (count + 1));
+        entries[count].name = cgdb_strdup(ent->d_name);
+        entries[count].size = st.st_size;
+        entries[count].mtime = st.st_mtime;
+        total += st.st_size;
+        count++;
+    }
+
+    closedir(dir);
+
+    if (total > HL_CACHE_SIZE) {
+        qsort(entries, count, sizeof (struct hl_cache_entry),
+                hl_cache_entry_compare);
+
+        for (i = 0; i < count && total > HL_CACHE_SIZE; i++) {
+            fs_util_get_path(hl_cache_dir, entries[i].name, file);
+            if (unlink(file) == 0)
+                total -= entries[i].size;
+        }
+    }
+
+    for (i = 0; i < count; i++)
+        free(entries[i].name);
+    free(entries);
+#endif /* HAVE_DIRENT_H */
+}
+
+/* hl_cache_data: Puts together the contents of the cache file of a file.
+ * --------------
+ *
+ *   node:  The file
+ *   size:  Returns the size of the contents
+ *
+ * Return Value: The contents, which must be freed, or NULL if a line has
+ *               not been lexed or the file would be too big.
+ */
+static char *hl_cache_data(struct list_node *node, size_t *size)
+{
+    struct hl_cache_header header;
+    long long data_size = 0;
+    char *data, *pos;
+    int i, count;
+
+    for (i = 0; i < node->buf.length; i++) {
+        if (!node->hl_spans[i])
+            return NULL;
+        data_size += sizeof (int) +
+                (hl_spans_count(node->hl_spans[i]) + 1) *
+                sizeof (struct hl_span);
+    }
+
+    if (data_size > HL_CACHE_FILE_SIZE)
+        return NULL;
+
+    hl_cache_header(node, &header, data_size);
+    *size = sizeof (header) + header.path_length + data_size;
+    data = cgdb_malloc(*size);
+
+    memcpy(data, &header, sizeof (header));
+    pos = data + sizeof (header);
+    memcpy(pos, node->path, header.path_length);
+    pos += header.path_length;
+
+    for (i = 0; i < node->buf.length; i++) {
+        count = hl_spans_count(node->hl_spans[i]);
+        memcpy(pos, &count, sizeof (int));
+        pos += sizeof (int);
+        memcpy(pos, node->hl_spans[i], sizeof (struct hl_span) * (count + 1));
+        pos += sizeof (struct hl_span) * (count + 1);
+    }
+
+    return data;
+}
+
+/* hl_cache_write: Writes a cache file, and trims the cache.
+ * ---------------
+ *
+ * The file is written under a temporary name first, so that a partly
+ * written file is never loaded.  This does not touch any list_node, so it
+ * can be called from any thread.
+ *
+ *   file:  The cache file
+ *   data:  Its contents
+ *   size:  The size of data
+ */
+static void hl_cache_write(const char *file, const char *data, size_t size)
+{
+    char tmp[FSUTIL_PATH_MAX + 8];
+    FILE *fp;
+    int error = 0;
+
+    sprintf(tmp, "%s.tmp", file);
+
+    fp = fopen(tmp, "wb");
+    if (!fp)
+        return;
+
+    if (fwrite(data, size, 1, fp) != 1)
+        error = 1;
+
+    if (fclose(fp) != 0)
+        error = 1;
+
+    if (error || rename(tmp, file) == -1) {
+        unlink(tmp);
+        return;
+    }
+
+    hl_cache_trim();
+}
+
+#if HL_WORKER
+/* ------------- */
+/* Worker thread */
+/* ------------- */
+
+/* Lines highlighted per pass of the worker through a file. Between passes,
+ * the main thread can get hold of the lexers. */
+#define HL_WORKER_LINES 1024
+
+/* A file the worker thread is highlighting. */
+struct hl_job {
+    struct hl_job *next;
+    char *path;                 /* The file, to find its list_node again */
+    unsigned long generation;   /* The hl_generation of the list_node */
+    enum tokenizer_language_support language;
+    char **lines;               /* The lines of the file, until the worker
+                                 * copies them into text */
+    char *text;                 /* A copy of the lines, ending in newlines */
+    int *offsets;               /* Where each line starts, plus the end */
+    int length;                 /* The number of lines */
+    int done;                   /* Lines before this have been lexed */
+    int state;                  /* Lexer state at the start of line done */
+    int want_start;             /* Lines wanted for display, if */
+    int want_end;               /* want_start < want_end */
+    int busy;                   /* The worker is using the job */
+    int cancelled;              /* The worker should free the job */
+};
+
+/* A cache file for the worker thread to write */
+struct hl_save {
+    struct hl_save *next;
+    char *file;                 /* The cache file */
+    char *data;                 /* Its contents */
+    size_t size;                /* The size of data */
+};
+
+/* A job stays on the list after the last of its lines are lexed, until the
+ * main thread installs them, so that it does not lex them again itself. */
+
+/* Lines the worker thread has highlighted. */
+struct hl_result {
+    struct hl_result *next;
+    char *path;
+    unsigned long generation;
+    int start;                  /* The first line */
+    int count;                  /* The number of lines */
+    int exact;                  /* If the lexer started in an exact state */
+    int final;                  /* If the rest of the file is done */
+    struct hl_span **spans;     /* The spans of each line */
+    int *states;                /* Lexer states, count + 1 entries */
+};
+
+/* The mutex protects all the variables below it */
+static pthread_mutex_t hl_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hl_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t hl_copied = PTHREAD_COND_INITIALIZER;
+static struct hl_job *hl_jobs = NULL;
+static struct hl_save *hl_saves = NULL;
+static struct hl_result *hl_results = NULL;
+static struct hl_result **hl_results_tail = &hl_results;
+static int hl_quit = 0;
+
+static pthread_t hl_thread;
+static int hl_running = 0;
+static int hl_pipe[2] = { -1, -1 };
+
+/* hl_job_free: Releases a job. */
+static void hl_job_free(struct hl_job *job)
+{
+    free(job->path);
+    free(job->text);
+    free(job->offsets);
+    free(job);
+}
+
+/* hl_save_free: Releases a cache file that was written. */
+static void hl_save_free(struct hl_save *save)
+{
+    free(save->file);
+    free(save->data);
+    free(save);
+}
+
+/* hl_job_unlink: Removes a job from the list of jobs. */
+static void hl_job_unlink(struct hl_job *job)
+{
+    struct hl_job **p;
+
+    for (p = &hl_jobs; *p; p = &(*p)->next) {
+        if (*p == job) {
+            *p = job->next;
+            break;
+        }
+    }
+}
+
+/* hl_job_find: Finds the job of a file, or returns NULL. */
+static struct hl_job *hl_job_find(struct list_node *node)
+{
+    struct hl_job *job;
+
+    for (job = hl_jobs; job; job = job->next)
+        if (job->generation == node->hl_generation && !job->cancelled)
+            return job;
+
+    return NULL;
+}
+
+/* hl_worker_lex: Lexes lines of a job and posts them as a result.
+ * --------------
+ *
+ * Called by the worker thread without holding hl_mutex. The job can not be
+ * freed meanwhile, since it is marked busy.
+ *
+ *   job:   The job
+ *   from:  The first line to lex
+ *   end:   One past the last line to lex
+ *   state: The lexer state at the start of line from
+ *   exact: If the state is exact, or a guess
+ *
+ * Return Value: The lexer state at the start of line end.
+ */
+static int hl_worker_lex(struct hl_job *job, int from, int end, int state,
+        int exact)
+{
+    struct hl_result *r = cgdb_malloc(sizeof (struct hl_result));
+    char c = 0;
+
+    r->next = NULL;
+    r->path = cgdb_strdup(job->path);
+    r->generation = job->generation;
+    r->start = from;
+    r->count = end - from;
+    r->exact = exact;
+    r->final = exact && end == job->length;
+    r->spans = cgdb_malloc(sizeof (struct hl_span *) * r->count);
+    r->states = cgdb_malloc(sizeof (int) * (r->count + 1));
+
+    hl_lex_text(job->text + job->offsets[from],
+            job->offsets[end] - job->offsets[from], r->count,
+            job->language, state, exact, r->spans, r->states);
+    state = r->states[r->count] != -1 ? r->states[r->count] : 0;
+
+    pthread_mutex_lock(&hl_mutex);
+    *hl_results_tail = r;
+    hl_results_tail = &r->next;
+    pthread_mutex_unlock(&hl_mutex);
+
+    /* Wake up the main loop */
+    write(hl_pipe[1], &c, 1);
+
+    return state;
+}
+
+/* hl_worker_copy: Copies the lines of a job, so the file can be unloaded or
+ * ---------------  reloaded while the worker lexes them.
+ *
+ * Called by the worker thread without holding hl_mutex. The main thread
+ * waits in highlight_cancel until the copy is done, before it frees the
+ * lines.
+ *
+ *   job:  The job
+ */
+static void hl_worker_copy(struct hl_job *job)
+{
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < job->length; i++)
+        size += strlen(job->lines[i]) + 1;
+
+    job->text = cgdb_malloc(size + 1);
+    job->offsets = cgdb_malloc(sizeof (int) * (job->length + 1));
+    for (size = 0, i = 0; i < job->length; i++) {
+        int len = strlen(job->lines[i]);
+
+        job->offsets[i] = size;
+        memcpy(job->text + size, job->lines[i], len);
+        size += len;
+        job->text[size++] = '\n';
+    }
+    job->offsets[job->length] = size;
+    job->text[size] = 0;
+}
+
+/* hl_worker_sync: Finds a line to start lexing a job at. See hl_sync. */
+static int hl_worker_sync(struct hl_job *job, int line)
+{
+    int from = line - HL_SYNC_LINES > 0 ? line - HL_SYNC_LINES : 0;
+    const char **lines = cgdb_malloc(sizeof (char *) * (line - from + 1));
+    int *lens = cgdb_malloc(sizeof (int) * (line - from + 1));
+    int i;
+
+    for (i = from; i < line; i++) {
+        lines[i - from] = job->text + job->offsets[i];
+        lens[i - from] = job->offsets[i + 1] - job->offsets[i] - 1;
+    }
+
+    i = from + hl_sync(job->language, lines, lens, line - from);
+
+    free(lines);
+    free(lens);
+
+    return i;
+}
+
+/* hl_worker: The worker thread.
+ * ----------
+ *
+ * Lines wanted for display are done first. Otherwise, the jobs are done
+ * in order, each from the top of the file to the bottom, a few lines at a
+ * time.
+ */
+static void *hl_worker(void *arg)
+{
+    pthread_mutex_lock(&hl_mutex);
+
+    while (!hl_quit) {
+        struct hl_save *save = hl_saves;
+        struct hl_job *job;
+        int start, end;
+
+        /* Cache files are written here, so the main thread does not wait
+         * on the disk */
+        if (save) {
+            hl_saves = save->next;
+            pthread_mutex_unlock(&hl_mutex);
+            hl_cache_write(save->file, save->data, save->size);
+            hl_save_free(save);
+            pthread_mutex_lock(&hl_mutex);
+            continue;
+        }
+
+        for (job = hl_jobs; job; job = job->next)
+            if (job->want_start < job->want_end && job->done < job->length)
+                break;
+
+        if (!job)
+            for (job = hl_jobs; job; job = job->next)
+                if (job->done < job->length)
+                    break;
+
+        if (!job) {
+            pthread_cond_wait(&hl_cond, &hl_mutex);
+            continue;
+        }
+
+        start = job->want_start;
+        end = job->want_end;
+        job->want_start = job->want_end = 0;
+        job->busy = 1;
+
+        if (job->lines) {
+            pthread_mutex_unlock(&hl_mutex);
+            hl_worker_copy(job);
+            pthread_mutex_lock(&hl_mutex);
+            job->lines = NULL;
+            pthread_cond_broadcast(&hl_copied);
+        }
+        pthread_mutex_unlock(&hl_mutex);
+
+        if (start < end && end > job->done &&
+                start - job->done > HL_SYNC_LINES) {
+            /* Too far ahead of the lines lexed so far, guess the state */
+            hl_worker_lex(job, hl_worker_sync(job, start), end, 0, 0);
+        } else {
+            /* Continue lexing the file, at least up to the wanted lines */
+            end = end > job->done + HL_WORKER_LINES ? end :
+                    job->done + HL_WORKER_LINES;
+            if (end > job->length)
+                end = job->length;
+
+            job->state = hl_worker_lex(job, job->done, end, job->state, 1);
+            job->done = end;
+        }
+
+        pthread_mutex_lock(&hl_mutex);
+        job->busy = 0;
+        if (job->cancelled) {
+            hl_job_unlink(job);
+            hl_job_free(job);
+        }
+    }
+
+    pthread_mutex_unlock(&hl_mutex);
+
+    return NULL;
+}
+
+/* hl_worker_add: Gives a file to the worker thread to highlight.
+ * --------------
+ *
+ * The worker copies the lines itself, see hl_worker_copy.
+ */
+static void hl_worker_add(struct list_node *node)
+{
+    struct hl_job *job, **p;
+
+    job = cgdb_malloc(sizeof (struct hl_job));
+    job->next = NULL;
+    job->path = cgdb_strdup(node->path);
+    job->generation = node->hl_generation;
+    job->language = node->language;
+    job->length = node->buf.length;
+    job->done = 0;
+    job->state = 0;
+    job->want_start = job->want_end = 0;
+    job->busy = 0;
+    job->cancelled = 0;
+    job->lines = node->buf.tlines;
+    job->text = NULL;
+    job->offsets = NULL;
+
+    pthread_mutex_lock(&hl_mutex);
+    for (p = &hl_jobs; *p; p = &(*p)->next);
+    *p = job;
+    pthread_cond_signal(&hl_cond);
+    pthread_mutex_unlock(&hl_mutex);
+}
+
+/* hl_worker_save: Gives a cache file to the worker thread to write.
+ * ---------------
+ *
+ *   file:  The cache file
+ *   data:  Its contents, which the worker frees
+ *   size:  The size of data
+ */
+static void hl_worker_save(const char *file, char *data, size_t size)
+{
+    struct hl_save *save, **p;
+
+    save = cgdb_malloc(sizeof (struct hl_save));
+    save->next = NULL;
+    save->file = cgdb_strdup(file);
+    save->data = data;
+    save->size = size;
+
+    pthread_mutex_lock(&hl_mutex);
+    for (p = &hl_saves; *p; p = &(*p)->next);
+    *p = save;
+    pthread_cond_signal(&hl_cond);
+    pthread_mutex_unlock(&hl_mutex);
+}
+#endif /* HL_WORKER */
+
+/* hl_cache_save: Writes the spans of a file to the cache.
+ * --------------
+ *
+ * Only called when every line of the file has been lexed from the top of
+ * the file.  The file is written by the worker thread when it is running.
+ *
+ *   node:  The file
+ */
+static void hl_cache_save(struct list_node *node)
+{
+    char file[FSUTIL_PATH_MAX];
+    size_t size;
+    char *data;
+
+    if (!hl_cache_dir[0] || node->buf.length == 0)
+        return;
+
+    data = hl_cache_data(node, &size);
+    if (!data)
+        return;
+
+    hl_cache_file(node, file);
+
+#if HL_WORKER
+    if (hl_running) {
+        hl_worker_save(file, data, size);
+        return;
+    }
+#endif /* HL_WORKER */
+
+    hl_cache_write(file, data, size);
+    free(data);
+}
+
+
+/* --------- */
+/* Functions */
+/* --------- */
+
+/* See comments in highlight.h for function descriptions. */
+
+void highlight(struct list_node *node)
+{
+    /* Forget the lines highlighted for an earlier language */
+    highlight_release(node);
+
+    /* Only the lines of a large file that are in memory are highlighted */
+    if (node->buf.large)
+        return;
+
+    hl_alloc(node);
+
+    /* The lines may be cached from an earlier run */
+    if (!node->hl_spans || hl_plain(node) || hl_cache_load(node))
+        return;
+
+#if HL_WORKER
+    if (hl_running)
+        hl_worker_add(node);
+#endif /* HL_WORKER */
+}
+
+void highlight_reload(struct list_node *node, const int *new_to_old,
+        int old_length)
+{
+    struct hl_span **old_spans = node->hl_spans;
+    const struct hl_span *last;
+    int *old_states;
+    int length = node->buf.length;
+    int i, k, o, exact;
+
+    /* The worker has a copy of the old text */
+    highlight_cancel(node);
+    free(node->hl_checkpoints);
+    node->hl_spans = NULL;
+    node->hl_checkpoints = NULL;
+
+    if (!old_spans || length == 0 || hl_plain(node) || node->buf.large) {
+        hl_lines_free(old_spans, old_length);
+        highlight(node);
+        return;
+    }
+
+    hl_alloc(node);
+
+    /* The new text may be cached already, say after switching branches */
+    if (hl_cache_load(node)) {
+        hl_lines_free(old_spans, old_length);
+        return;
+    }
+
+    /* Move the spans of the lines that did not change over */
+    old_states = cgdb_malloc(sizeof (int) * length);
+    for (i = 0; i < length; i++) {
+        o = new_to_old[i];
+        old_states[i] = -1;
+
+        if (o == 0) {
+            old_states[i] = 0;
+        } else if (o > 0 && old_spans[o - 1]) {
+            last = hl_spans_end(old_spans[o - 1]);
+            if (last->group)
+                old_states[i] = last->start;
+        }
+    }
+
+    for (i = 0; i < length; i++) {
+        o = new_to_old[i];
+        if (o != -1) {
+            node->hl_spans[i] = old_spans[o];
+            old_spans[o] = NULL;
+        }
+    }
+    hl_lines_free(old_spans, old_length);
+
+    hl_relex(node, new_to_old, old_states);
+    free(old_states);
+
+    /* Checkpoints in the lines that were moved over */
+    for (k = 1; k * HL_CHECKPOINT_LINES < length; k++) {
+        struct hl_checkpoint *cp = &node->hl_checkpoints[k];
+        struct hl_span *spans = node->hl_spans[k * HL_CHECKPOINT_LINES - 1];
+
+        if (cp->known == HL_STATE_UNKNOWN && spans) {
+            last = hl_spans_end(spans);
+            cp->state = last->start;
+            cp->known = last->group ? HL_STATE_EXACT : HL_STATE_GUESSED;
+        }
+    }
+
+    exact = 1;
+    for (i = 0; i < length && node->hl_spans[i]; i++)
+        if (!hl_spans_end(node->hl_spans[i])->group)
+            exact = 0;
 
-#if HAVE_STDLIB_H
-#include <stdlib.h>
-#endif /* HAVE_STDLIB_H */
+    if (i == length) {
+        if (exact)
+            hl_cache_save(node);
+        return;
+    }
 
-#ifdef HAVE_SYS_TYPES_H
-#include <sys/types.h>
-#endif /* HAVE_SYS_TYPES_H */
+#if HL_WORKER
+    /* Some lines have to be highlighted again */
+    if (hl_running)
+        hl_worker_add(node);
+#endif /* HL_WORKER */
+}
 
-#if HAVE_REGEX_H
-#include <regex.h>
-#endif /* HAVE_REGEX_H */
+void highlight_release(struct list_node *node)
+{
+    highlight_cancel(node);
 
-/* Local Includes */
-#include "highlight.h"
-#include "highlight_groups.h"
-#include "sources.h"
-#include "cgdb.h"
-#include "tokenizer.h"
-#include "interface.h"
-#include "sys_util.h"
-#include "logger.h"
+    hl_lines_free(node->hl_spans, node->buf.length);
+    node->hl_spans = NULL;
 
-/* ----------- */
-/* Definitions */
-/* ----------- */
+    free(node->hl_checkpoints);
+    node->hl_checkpoints = NULL;
+}
 
-#define HL_CHAR CHAR_MAX        /* Special marker character */
+size_t highlight_memory(struct list_node *node)
+{
+    size_t size = 0;
+    int i;
 
-/* --------------- */
-/* Local Variables */
-/* --------------- */
+    if (!node->hl_spans)
+        return 0;
 
-static int highlight_node(struct list_node *node)
+    for (i = 0; i < node->buf.length; i++)
+        size += hl_spans_size(node->hl_spans[i]);
+
+    return size + sizeof (struct hl_span *) * node->buf.length +
+            sizeof (struct hl_checkpoint) *
+            (node->buf.length / HL_CHECKPOINT_LINES + 1);
+}
+
+long highlight_lines(struct list_node *node, int start, int end)
 {
-    struct tokenizer *t = tokenizer_init();
-    int ret;
-    struct ibuf *ibuf = ibuf_init();
+    int from, state, exact;
+    long bytes = 0;
+    int i, k;
+
+    if (!node->hl_spans || !hl_missing(node, &start, &end))
+        return 0;
+
+    if (!hl_plain(node)) {
+        /* Start at the closest checkpoint in front of the lines, preferring
+         * one that is exact over one that was guessed */
+        from = -1;
+        state = 0;
+        exact = 0;
+        for (k = start / HL_CHECKPOINT_LINES;
+                k >= 0 && k * HL_CHECKPOINT_LINES >= start - HL_SYNC_LINES;
+                k--) {
+            struct hl_checkpoint *cp = &node->hl_checkpoints[k];
+
+            if (cp->known == HL_STATE_EXACT) {
+                from = k * HL_CHECKPOINT_LINES;
+                state = cp->state;
+                exact = 1;
+                break;
+            }
+
+            if (cp->known == HL_STATE_GUESSED && from == -1) {
+                from = k * HL_CHECKPOINT_LINES;
+                state = cp->state;
+            }
+        }
 
-    ibuf_addchar(ibuf, HL_CHAR);
-    ibuf_addchar(ibuf, HLG_TEXT);
+        /* Nothing is known about this part of the file, make a guess */
+        if (from == -1) {
+            from = hl_sync(node->language,
+                    (const char **) node->buf.tlines, NULL, start);
+            state = 0;
+        }
 
-    /* Initialize */
-    node->buf.length = 0;
-    node->buf.tlines = NULL;
-    node->buf.max_width = 0;
+        bytes += hl_lex(node, from, end, state, exact);
 
-    if (tokenizer_set_file(t, node->path, node->language) == -1) {
-        if_print_message("%s:%d tokenizer_set_file error", __FILE__, __LINE__);
-        return -1;
+        if (exact && from == 0 && end == node->buf.length)
+            hl_cache_save(node);
     }
 
-    while ((ret = tokenizer_get_token(t)) > 0) {
-        enum tokenizer_type e = tokenizer_get_packet_type(t);
+    /* Lines the lexer did not get to are shown without color */
+    for (i = start; i < end; i++)
+        if (!node->hl_spans[i])
+            node->hl_spans[i] = &hl_no_spans[0];
 
-        /*if_print_message  ( "TOKEN(%d:%s)\n", e, tokenizer_get_printable_enum ( e ) ); */
+    return bytes;
+}
 
-        switch (e) {
-            case TOKENIZER_KEYWORD:
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_KEYWORD);
-                ibuf_add(ibuf, tokenizer_get_data(t));
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_TEXT);
-                break;
-            case TOKENIZER_TYPE:
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_TYPE);
-                ibuf_add(ibuf, tokenizer_get_data(t));
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_TEXT);
-                break;
-            case TOKENIZER_LITERAL:
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_LITERAL);
-                ibuf_add(ibuf, tokenizer_get_data(t));
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_TEXT);
-                break;
-            case TOKENIZER_NUMBER:
-                ibuf_add(ibuf, tokenizer_get_data(t));
-                break;
-            case TOKENIZER_COMMENT:
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_COMMENT);
-                ibuf_add(ibuf, tokenizer_get_data(t));
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_TEXT);
-                break;
-            case TOKENIZER_DIRECTIVE:
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_DIRECTIVE);
-                ibuf_add(ibuf, tokenizer_get_data(t));
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_TEXT);
-                break;
-            case TOKENIZER_TEXT:
-                ibuf_add(ibuf, tokenizer_get_data(t));
-                break;
-            case TOKENIZER_NEWLINE:
-                node->buf.length++;
-                node->buf.tlines =
-                        realloc(node->buf.tlines,
-                        sizeof (char *) * node->buf.length);
-                node->buf.tlines[node->buf.length - 1] = strdup(ibuf_get(ibuf));
-
-                if (ibuf_length(ibuf) > node->buf.max_width)
-                    node->buf.max_width = ibuf_length(ibuf);
-
-                ibuf_clear(ibuf);
-                ibuf_addchar(ibuf, HL_CHAR);
-                ibuf_addchar(ibuf, HLG_TEXT);
-                break;
-            case TOKENIZER_ERROR:
-                ibuf_add(ibuf, tokenizer_get_data(t));
-                break;
-            default:
-                return -1;
-                break;
-        }
+struct hl_span **highlight_block(enum tokenizer_language_support language,
+        char **lines, int count, long *bytes)
+{
+    struct ibuf *text;
+    struct hl_span **spans;
+    int *states;
+    int i;
+
+    *bytes = 0;
+
+    if (language == TOKENIZER_LANGUAGE_UNKNOWN || !has_colors() || count == 0)
+        return NULL;
+
+    text = ibuf_init();
+    for (i = 0; i < count; i++) {
+        ibuf_add(text, lines[i]);
+        ibuf_addchar(text, '\n');
     }
 
-    return 0;
+    spans = cgdb_malloc(sizeof (struct hl_span *) * count);
+    states = cgdb_malloc(sizeof (int) * (count + 1));
+
+    if (hl_lex_text(ibuf_get(text), ibuf_length(text), count, language, 0,
+                    0, spans, states) == -1)
+        if_print_message("%s:%d tokenizer_set_buffer error",
+                __FILE__, __LINE__);
+
+    for (i = 0; i < count; i++) {
+        if (!spans[i])
+            spans[i] = &hl_no_spans[0];
+        *bytes += hl_spans_size(spans[i]);
+    }
+    *bytes += sizeof (struct hl_span *) * count;
+
+    free(states);
+    ibuf_free(text);
+
+    return spans;
 }
 
-/* --------- */
-/* Functions */
-/* --------- */
+void highlight_block_free(struct hl_span **spans, int count)
+{
+    hl_lines_free(spans, count);
+}
 
-/* See comments in highlight.h for function descriptions. */
+int highlight_request(struct list_node *node, int start, int end)
+{
+#if HL_WORKER
+    struct hl_job *job;
+
+    if (!node->hl_spans || !hl_missing(node, &start, &end))
+        return 0;
+
+    pthread_mutex_lock(&hl_mutex);
+    job = hl_job_find(node);
+    if (job) {
+        job->want_start = start;
+        job->want_end = end;
+        pthread_cond_signal(&hl_cond);
+    }
+    pthread_mutex_unlock(&hl_mutex);
 
-void highlight(struct list_node *node)
+    if (job)
+        return 0;
+#endif /* HL_WORKER */
+
+    return -1;
+}
+
+void highlight_cancel(struct list_node *node)
 {
-    if (node->language == TOKENIZER_LANGUAGE_UNKNOWN) {
-        /* Just copy the lines from the original buffer if no highlighting 
-         * is possible */
-        int i;
+#if HL_WORKER
+    struct hl_job *job;
+
+    pthread_mutex_lock(&hl_mutex);
+    job = hl_job_find(node);
 
-        node->buf.length = node->orig_buf.length;
-        node->buf.max_width = node->orig_buf.max_width;
-        node->buf.tlines = cgdb_malloc(sizeof (char *) * node->orig_buf.length);
-        for (i = 0; i < node->orig_buf.length; i++)
-            node->buf.tlines[i] = cgdb_strdup(node->orig_buf.tlines[i]);
-    } else
-        highlight_node(node);
+    /* The lines can not be freed while the worker copies them */
+    while (job && job->busy && job->lines)
+        pthread_cond_wait(&hl_copied, &hl_mutex);
+
+    if (job) {
+        /* The worker frees the job when it is done with it */
+        if (job->busy) {
+            job->cancelled = 1;
+        } else {
+            hl_job_unlink(job);
+            hl_job_free(job);
+        }
+    }
+    pthread_mutex_unlock(&hl_mutex);
+#endif /* HL_WORKER */
 }
 
-/* highlight_line_segment: Creates a new line that is hightlighted.
- * ------------------------
- *
- *  orig:   The line that needs to be highlighted.
- *  start:  The desired starting position of the highlighted portion.
- *          The start index *is* included in the highlighted segment.
- *  end:    The desired ending position of the highlighted portion.
- *          The end index *is not* include in the highlighted segment.
- *
- *  Return Value: Null on error. Or a pointer to a new line that
- *  has highlighting. The new line MUST BE FREED.
- */
-/*#define HIGHLIGHT_DEBUG*/
-static char *highlight_line_segment(const char *orig, int start, int end)
+void highlight_cache_init(const char *dir)
 {
-    char *new_line = NULL;
-    int length = strlen(orig), j = 0, pos = 0;
-    int syn_search_recieved = 0, cur_color = HLG_TEXT;
+    hl_cache_dir[0] = 0;
 
-    /* Cases not possible */
-    if (start > end || orig == NULL ||
-            start > length || start < 0 || end > length || end < 0)
-        return NULL;
+    if (fs_util_create_dir_in_base(dir, HL_CACHE_DIR))
+        fs_util_get_path(dir, HL_CACHE_DIR, hl_cache_dir);
+}
 
-    /* The 5 is: color start (2), color end (2) and EOL */
-    if ((new_line = (char *) malloc(sizeof (char) * (length + 5))) == NULL)
-        return NULL;
+int highlight_worker_start(void)
+{
+#if HL_WORKER
+    sigset_t all, old;
+    int result;
 
-#ifdef HIGHLIGHT_DEBUG
-    /*
-       for ( j = 0; j < strlen(orig); j++ ) {
-       char temp[100];
-       sprintf(temp, "(%d:%c)", orig[j], orig[j]);
-       scr_add(gdb_win, temp);
-       }
-       scr_add(gdb_win, "\r\n");
-       scr_refresh(gdb_win, 1);
-     */
-#endif
+    if (hl_running)
+        return hl_pipe[0];
 
-    /* This traverses the input line. It creates a new line with the section
-     *     given highlighted.
-     * If a highlight symbol is encountered, the end and/or start position 
-     *     is incremented because the original match was against only the text,
-     *     not against the color embedded text :)
-     */
-    for (j = 0; j < length; j++) {
-        if (orig[j] == HL_CHAR) {
-            if (j <= start)
-                start += 2;
+    if (pipe(hl_pipe) == -1)
+        return -1;
 
-            if (j <= end)
-                end += 2;
+    fcntl(hl_pipe[0], F_SETFL, fcntl(hl_pipe[0], F_GETFL) | O_NONBLOCK);
 
-            cur_color = orig[j + 1];
-        }
+    /* Signals are handled by the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    result = pthread_create(&hl_thread, NULL, hl_worker, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
 
-        /* Mark when the search is started and when it ends */
-        if (j == start) {
-            syn_search_recieved = 1;
-            new_line[pos++] = HL_CHAR;
-            new_line[pos++] = HLG_SEARCH;
-        } else if (j == end) {
-            syn_search_recieved = 0;
-            new_line[pos++] = HL_CHAR;
-            new_line[pos++] = cur_color;
-        }
+    if (result != 0) {
+        close(hl_pipe[0]);
+        close(hl_pipe[1]);
+        hl_pipe[0] = hl_pipe[1] = -1;
+        return -1;
+    }
 
-        new_line[pos++] = orig[j];
+    hl_quit = 0;
+    hl_running = 1;
 
-        /* If the search has started, then make all the colors the 
-         * highlighted colors  */
-        if (syn_search_recieved && orig[j] == HL_CHAR) {
-            ++j;
-            new_line[pos++] = HLG_SEARCH;
-        }
+    return hl_pipe[0];
+#else
+    return -1;
+#endif /* HL_WORKER */
+}
+
+void highlight_worker_stop(void)
+{
+#if HL_WORKER
+    struct hl_result *r;
+
+    if (!hl_running)
+        return;
+
+    pthread_mutex_lock(&hl_mutex);
+    hl_quit = 1;
+    pthread_cond_signal(&hl_cond);
+    pthread_mutex_unlock(&hl_mutex);
+
+    pthread_join(hl_thread, NULL);
+    hl_running = 0;
+
+    while (hl_jobs) {
+        struct hl_job *job = hl_jobs;
+
+        hl_jobs = job->next;
+        hl_job_free(job);
+    }
+
+    /* The cache files the worker did not get to */
+    while (hl_saves) {
+        struct hl_save *save = hl_saves;
+
+        hl_saves = save->next;
+        hl_cache_write(save->file, save->data, save->size);
+        hl_save_free(save);
+    }
+
+    while ((r = highlight_get_result()))
+        highlight_free_result(r);
+
+    close(hl_pipe[0]);
+    close(hl_pipe[1]);
+    hl_pipe[0] = hl_pipe[1] = -1;
+#endif /* HL_WORKER */
+}
+
+int highlight_worker_fd(void)
+{
+#if HL_WORKER
+    if (hl_running)
+        return hl_pipe[0];
+#endif /* HL_WORKER */
+
+    return -1;
+}
+
+struct hl_result *highlight_get_result(void)
+{
+#if HL_WORKER
+    struct hl_result *r;
+    char buf[64];
+
+    /* Each result wrote a byte to the pipe */
+    while (read(hl_pipe[0], buf, sizeof (buf)) > 0);
+
+    pthread_mutex_lock(&hl_mutex);
+    r = hl_results;
+    if (r) {
+        hl_results = r->next;
+        if (!hl_results)
+            hl_results_tail = &hl_results;
     }
+    pthread_mutex_unlock(&hl_mutex);
+
+    return r;
+#else
+    return NULL;
+#endif /* HL_WORKER */
+}
+
+const char *highlight_result_path(struct hl_result *r, int *start, int *end)
+{
+#if HL_WORKER
+    *start = r->start;
+    *end = r->start + r->count;
+    return r->path;
+#else
+    return NULL;
+#endif /* HL_WORKER */
+}
+
+long highlight_install_result(struct list_node *node, struct hl_result *r)
+{
+    long bytes = 0;
 
-    new_line[pos] = '\0';
+#if HL_WORKER
+    /* The file was highlighted again or reloaded since the job started */
+    if (node->hl_generation != r->generation || !node->hl_spans) {
+        highlight_free_result(r);
+        return 0;
+    }
 
-#ifdef HIGHLIGHT_DEBUG
-    for (j = 0; j < strlen(new_line); j++) {
-        char temp[100];
+    bytes = hl_install(node, r->start, r->count, r->spans, r->states,
+            r->exact);
 
-        fprintf(stderr, "(%d:%c)\r\n", new_line[j], new_line[j]);
+    /* Every line of the file has been lexed from the top now, and the
+     * job is no longer needed */
+    if (r->final) {
+        highlight_cancel(node);
+        hl_cache_save(node);
     }
-#endif
 
-    /* Now the line has new information in it.
-     * Lets traverse it again and correct the highlighting to be the 
-     * reverse.
-     */
+    free(r->path);
+    free(r->spans);
+    free(r->states);
+    free(r);
+#endif /* HL_WORKER */
+
+    return bytes;
+}
+
+void highlight_free_result(struct hl_result *r)
+{
+#if HL_WORKER
+    int i;
+
+    for (i = 0; i < r->count; i++)
+        if (r->spans[i])
+            hl_spans_free(r->spans[i]);
+
+    free(r->path);
+    free(r->spans);
+    free(r->states);
+    free(r);
+#endif /* HL_WORKER */
+}
 
-    return new_line;
+/* Size of the buffer hl_wprintw collects a run of characters in */
+#define HL_RUN_SIZE 256
+
+/* hl_flush_run: Writes out the characters collected so far by hl_wprintw.
+ * -------------
+ *
+ *   win:    The curses window to write to
+ *   run:    The characters to write
+ *   length: The number of characters in run, reset to 0
+ */
+static void hl_flush_run(WINDOW * win, const char *run, int *length)
+{
+    if (*length > 0)
+        waddnstr(win, run, *length);
+    *length = 0;
 }
 
-void hl_wprintw(WINDOW * win, const char *line, int width, int offset)
+void hl_wprintw(WINDOW * win, const char *line, const struct hl_span *spans,
+        const struct hl_match *matches, int width, int offset, int match_beg,
+        int match_end)
 {
     int length;                 /* Length of the line passed in */
     enum hl_group_kind color;   /* Color used to print current char */
+    enum hl_group_kind group;   /* Color of the current char */
     int i;                      /* Loops through the line char by char */
     int j;                      /* General iterator */
     int p;                      /* Count of chars printed to screen */
     int pad;                    /* Used to pad partial tabs */
-    int attr;                   /* A temp variable used for attributes */
+    int attr = 0;               /* A temp variable used for attributes */
+    char run[HL_RUN_SIZE];      /* Characters of the current color */
+    int run_length = 0;         /* Number of characters in run */
     int highlight_tabstop = cgdbrc_get(CGDBRC_TABSTOP)->variant.int_val;
 
-    /* Jump ahead to the character at offset (process color commands too) */
+    /* Jump ahead to the character at offset */
     length = strlen(line);
-    color = HLG_TEXT;
 
     for (i = 0, j = 0; i < length && j < offset; i++) {
-        if (line[i] == HL_CHAR && i + 1 < length) {
-            /* Even though we're not printing anything in this loop,
-             * the color attribute needs to be maintained for when we
-             * start printing in the loop below.  This way the text
-             * printed will be done in the correct color. */
-            color = (int) line[++i];
-        } else if (line[i] == '\t') {
+        if (line[i] == '\t') {
             /* Tab character, expand to size set by user */
             j += highlight_tabstop - (j % highlight_tabstop);
         } else {
@@ -297,78 +1976,359 @@ void hl_wprintw(WINDOW * win, const char *line, int width, int offset)
     pad = j - offset;
 
     /* Pad tab spaces if offset is less than the size of a tab */
-    for (j = 0, p = 0; j < pad && p < width; j++, p++)
-        wprintw(win, " ");
-
-    /* Set the color appropriately */
-    if (hl_groups_get_attr(hl_groups_instance, color, &attr) == -1) {
-        logger_write_pos(logger, __FILE__, __LINE__,
-                "hl_groups_get_attr error");
-        return;
+    for (j = 0, p = 0; j < pad && p < width; j++, p++) {
+        if (run_length == HL_RUN_SIZE)
+            hl_flush_run(win, run, &run_length);
+        run[run_length++] = ' ';
     }
+    hl_flush_run(win, run, &run_length);
 
-    wattron(win, attr);
-
-    /* Print string 1 char at a time */
+    /* Collect the string into runs of characters in the same group, and
+     * write each run out at once when the group changes */
+    color = HLG_LAST;
     for (; i < length && p < width; i++) {
-        if (line[i] == HL_CHAR) {
-            if (++i < length) {
-                wattroff(win, attr);
-                color = (int) line[i];
-
-                if (hl_groups_get_attr(hl_groups_instance, color, &attr) == -1) {
-                    logger_write_pos(logger, __FILE__, __LINE__,
-                            "hl_groups_get_attr error");
-                    return;
-                }
-
-                wattron(win, attr);
+        while (spans && spans->length && spans->start + spans->length <= i)
+            spans++;
+        while (matches && matches->end > matches->beg && matches->end <= i)
+            matches++;
+
+        if (i >= match_beg && i < match_end)
+            group = HLG_SEARCH;
+        else if (matches && matches->end > matches->beg && matches->beg <= i)
+            group = HLG_HLSEARCH;
+        else if (spans && spans->length && spans->start <= i)
+            group = spans->group;
+        else
+            group = HLG_TEXT;
+
+        if (group != color) {
+            hl_flush_run(win, run, &run_length);
+            wattroff(win, attr);
+            color = group;
+
+            if (hl_groups_get_attr(hl_groups_instance, color, &attr) == -1) {
+                logger_write_pos(logger, __FILE__, __LINE__,
+                        "hl_groups_get_attr error");
+                return;
             }
-        } else {
-            switch (line[i]) {
-                case '\t':
-                    do {
-                        wprintw(win, " ");
-                        p++;
-                    } while ((p + offset) % highlight_tabstop > 0 && p < width);
-                    break;
-                default:
-                    wprintw(win, "%c", line[i]);
+
+            wattron(win, attr);
+        }
+
+        switch (line[i]) {
+            case '\t':
+                do {
+                    if (run_length == HL_RUN_SIZE)
+                        hl_flush_run(win, run, &run_length);
+                    run[run_length++] = ' ';
                     p++;
-            }
+                } while ((p + offset) % highlight_tabstop > 0 && p < width);
+                break;
+            default:
+                if (run_length == HL_RUN_SIZE)
+                    hl_flush_run(win, run, &run_length);
+                run[run_length++] = line[i];
+                p++;
         }
     }
+    hl_flush_run(win, run, &run_length);
 
     /* Shut off color attribute */
     wattroff(win, attr);
 
-    for (; p < width; p++)
-        wprintw(win, " ");
+    for (; p < width; p++) {
+        if (run_length == HL_RUN_SIZE)
+            hl_flush_run(win, run, &run_length);
+        run[run_length++] = ' ';
+    }
+    hl_flush_run(win, run, &run_length);
+}
+
+/* The number of compiled regular expressions hl_regex keeps */
+#define HL_REGEX_CACHE_SIZE 8
+
+/* A compiled regular expression */
+struct hl_regex_entry {
+    char *regex;                /* The pattern, NULL if the entry is unused */
+    int cflags;                 /* The flags it was compiled with */
+    regex_t t;                  /* The compiled expression */
+    unsigned long used;         /* When it was last used */
+};
+
+static struct hl_regex_entry hl_regex_cache[HL_REGEX_CACHE_SIZE];
+static unsigned long hl_regex_clock = 0;
+
+/* Where the last search matched, so that a search for a pattern that only
+ * adds to the end of it can start there. */
+static struct {
+    const void *data;           /* The lines searched, NULL if none */
+    hl_get_line get_line;
+    int length;
+    char *regex;                /* The pattern searched for */
+    int icase;                  /* The rest of what was searched for */
+    int direction;
+    int wrapscan;
+    int sel_rline;
+    int sel_col_rbeg;
+    int sel_col_rend;
+    int line;                   /* The line that matched, or -1 if none */
+    int wrapped;                /* Nonzero if the search wrapped to find it */
+} hl_resume;
+
+/* hl_regex_compile: Gets a compiled regular expression.
+ * -----------------
+ *
+ * The last few expressions are kept compiled, so that searching for the
+ * same pattern again does not compile it again.
+ *
+ *   regex:   The pattern
+ *   cflags:  The flags to pass to regcomp
+ *
+ * Return Value: The expression, which belongs to the cache, or NULL if the
+ *               pattern is not valid.
+ */
+static regex_t *hl_regex_compile(const char *regex, int cflags)
+{
+    struct hl_regex_entry *entry = &hl_regex_cache[0];
+    int i;
+
+    for (i = 0; i < HL_REGEX_CACHE_SIZE; i++) {
+        struct hl_regex_entry *e = &hl_regex_cache[i];
+
+        if (e->regex && e->cflags == cflags && strcmp(e->regex, regex) == 0) {
+            e->used = ++hl_regex_clock;
+            return &e->t;
+        }
+
+        /* Replace an unused entry, or else the least recently used */
+        if (!e->regex || (entry->regex && e->used < entry->used))
+            entry = e;
+    }
+
+    if (entry->regex) {
+        regfree(&entry->t);
+        free(entry->regex);
+        entry->regex = NULL;
+    }
+
+    if (regcomp(&entry->t, regex, cflags) != 0) {
+        regfree(&entry->t);
+        return NULL;
+    }
+
+    entry->regex = cgdb_strdup(regex);
+    entry->cflags = cflags;
+    entry->used = ++hl_regex_clock;
+
+    return &entry->t;
+}
+
+/* hl_regex_resume: Checks if a search can start where the last one matched.
+ * ----------------
+ *
+ * If the pattern is the last one with only plain characters added to the
+ * end, every match of it starts where a match of the last pattern starts.
+ * The lines the last search went through before the one it matched on can
+ * then be skipped, and if the last search did not match, neither will
+ * this one.
+ *
+ * Return Value: Nonzero if hl_resume can be used.
+ */
+static int hl_regex_resume(const char *regex, hl_get_line get_line,
+        const void *data, int length, int sel_rline, int sel_col_rbeg,
+        int sel_col_rend, int direction, int icase, int wrapscan)
+{
+    size_t n;
+    const char *p;
+
+    if (!hl_resume.data || hl_resume.data != data ||
+            hl_resume.get_line != get_line || hl_resume.length != length ||
+            hl_resume.sel_rline != sel_rline ||
+            hl_resume.sel_col_rbeg != sel_col_rbeg ||
+            hl_resume.sel_col_rend != sel_col_rend ||
+            hl_resume.direction != direction || hl_resume.icase != icase ||
+            hl_resume.wrapscan != wrapscan)
+        return 0;
+
+    n = strlen(hl_resume.regex);
+    if (strncmp(regex, hl_resume.regex, n) != 0)
+        return 0;
+
+    if (regex[n] == '\0')
+        return 1;
+
+    if (n == 0 || !search_plain(hl_resume.regex[n - 1]))
+        return 0;
+
+    for (p = regex + n; *p; p++)
+        if (!search_plain(*p))
+            return 0;
+
+    return 1;
+}
+
+struct hl_match *hl_regex_matches(const char *regex, int icase,
+        const char *line)
+{
+    /* The same flags as hl_regex, so the matches drawn are the ones found */
+    int cflags = icase ? REG_ICASE : 0;
+    int length = strlen(line);
+    struct search_pattern pattern;
+    struct hl_match *matches;
+    int count = 0, size = 1;
+    regmatch_t pmatch[1];
+    regex_t *t;
+    int column = 0;
+
+    matches = (struct hl_match *) cgdb_malloc(sizeof (struct hl_match));
+
+    t = hl_regex_compile(regex, cflags);
+    if (t != NULL)
+        search_pattern_init(&pattern, t, regex, cflags);
+
+    while (t != NULL &&
+            search_next(&pattern, line, column, length, pmatch)) {
+        /* An empty match would not move on to the next one */
+        if (pmatch[0].rm_eo == pmatch[0].rm_so) {
+            column = pmatch[0].rm_so + 1;
+            continue;
+        }
+
+        if (count + 1 == size) {
+            size *= 2;
+            matches = (struct hl_match *) cgdb_realloc(matches,
+                    sizeof (struct hl_match) * size);
+        }
+
+        matches[count].beg = pmatch[0].rm_so;
+        matches[count].end = pmatch[0].rm_eo;
+        count++;
+        column = pmatch[0].rm_eo;
+    }
+
+    matches[count].beg = matches[count].end = 0;
+
+    return matches;
+}
+
+void hl_regex_forget(const void *data)
+{
+    if (hl_resume.data == data) {
+        hl_resume.data = NULL;
+        free(hl_resume.regex);
+        hl_resume.regex = NULL;
+    }
+}
+
+/* hl_regex_lines: Finds the nearest line that matches in a range.
+ * ---------------
+ *
+ * The lines are searched in parallel if they can all be read at once.
+ *
+ *   pattern:    What to look for
+ *   get_line:   Gets each line of text to search
+ *   data:       Passed to get_line
+ *   lines:      Every line, or NULL
+ *   from:       The line to search first
+ *   to:         The line to search last
+ *   direction:  1 if forward, 0 if reverse
+ *   pmatch:     Set to where the line matched
+ *
+ * Return Value: The line that matched, or -1 if none did.
+ */
+static int hl_regex_lines(const struct search_pattern *pattern,
+        hl_get_line get_line, void *data, char **lines, int from, int to,
+        int direction, regmatch_t *pmatch)
+{
+    int step = direction ? 1 : -1;
+    int i;
+
+    if ((to - from) * step < 0)
+        return -1;
+
+    if (lines)
+        return search_lines(pattern, lines, from, to, direction, pmatch);
+
+    for (i = from; i != to + step; i += step) {
+        const char *line = get_line(data, i);
+
+        if (direction ? search_first(pattern, line, pmatch) :
+                search_last(pattern, line, INT_MAX, pmatch))
+            return i;
+    }
+
+    return -1;
+}
+
+/* hl_regex_search: Finds the nearest line that matches in a range.
+ * ----------------
+ *
+ * On the line the search started from, a forward search only looks after
+ * the last match, and a reverse search only looks before it.
+ *
+ *   The arguments are as for hl_regex_lines, and
+ *   sel_rline:     The line the search started from
+ *   sel_col_rbeg:  Where the last match on it starts
+ *   sel_col_rend:  Where the last match on it ends
+ *
+ * Return Value: The line that matched, or -1 if none did.
+ */
+static int hl_regex_search(const struct search_pattern *pattern,
+        hl_get_line get_line, void *data, char **lines, int from, int to,
+        int direction, int sel_rline, int sel_col_rbeg, int sel_col_rend,
+        regmatch_t *pmatch)
+{
+    int step = direction ? 1 : -1;
+    const char *line;
+    int i;
+
+    /* Search the lines around the selected one on their own */
+    if ((sel_rline - from) * step < 0 || (to - sel_rline) * step < 0)
+        return hl_regex_lines(pattern, get_line, data, lines, from, to,
+                direction, pmatch);
+
+    i = hl_regex_lines(pattern, get_line, data, lines, from,
+            sel_rline - step, direction, pmatch);
+    if (i != -1)
+        return i;
+
+    line = get_line(data, sel_rline);
+    if (direction) {
+        if (sel_col_rend < (int) strlen(line) &&
+                search_first(pattern, line + sel_col_rend, pmatch)) {
+            pmatch[0].rm_so += sel_col_rend;
+            pmatch[0].rm_eo += sel_col_rend;
+            return sel_rline;
+        }
+    } else if (search_last(pattern, line, sel_col_rbeg - 1, pmatch))
+        return sel_rline;
+
+    return hl_regex_lines(pattern, get_line, data, lines, sel_rline + step,
+            to, direction, pmatch);
 }
 
-int hl_regex(const char *regex, const char **hl_lines, const char **tlines,
-        const int length, char **cur_line, int *sel_line,
-        int *sel_rline, int *sel_col_rbeg, int *sel_col_rend,
+int hl_regex(const char *regex, hl_get_line get_line, void *data,
+        char **lines, const int length, int *match_beg, int *match_end,
+        int *sel_line, int *sel_rline, int *sel_col_rbeg, int *sel_col_rend,
         int opt, int direction, int icase)
 {
-    regex_t t;                  /* Regular expression */
+    regex_t *t;                 /* Regular expression */
+    int cflags = icase ? REG_ICASE : 0;     /* A basic regular expression */
+    struct search_pattern pattern;  /* What to look for on each line */
     regmatch_t pmatch[1];       /* Indexes of matches */
-    int i = 0, result = 0;
-    char *local_cur_line;
+    int i = -1;
     int success = 0;
-    int offset = 0;
+    int resume;                 /* If the last search can be resumed */
+    int wrapped = 0;            /* If the search wrapped around */
     int config_wrapscan = cgdbrc_get(CGDBRC_WRAPSCAN)->variant.int_val;
 
-    if (tlines == NULL || tlines[0] == NULL ||
-            cur_line == NULL || sel_line == NULL ||
+    if (get_line == NULL || length == 0 ||
+            match_beg == NULL || match_end == NULL || sel_line == NULL ||
             sel_rline == NULL || sel_col_rbeg == NULL || sel_col_rend == NULL)
         return -1;
 
-    /* Clear last highlighted line */
-    if (*cur_line != NULL) {
-        free(*cur_line);
-        *cur_line = NULL;
-    }
+    /* Clear last match */
+    *match_beg = *match_end = -1;
 
     /* If regex is empty, set current line to original line */
     if (regex == NULL || *regex == '\0') {
@@ -377,117 +2337,115 @@ int hl_regex(const char *regex, const char **hl_lines, const char **tlines,
     }
 
     /* Compile the regular expression */
-    if (regcomp(&t, regex, REG_EXTENDED & (icase) ? REG_ICASE : 0) != 0) {
-        regfree(&t);
+    t = hl_regex_compile(regex, cflags);
+    if (t == NULL)
         return -3;
-    }
+
+    search_pattern_init(&pattern, t, regex, cflags);
+
+    resume = hl_regex_resume(regex, get_line, data, length, *sel_rline,
+            *sel_col_rbeg, *sel_col_rend, direction, icase, config_wrapscan);
 
     /* Forward search */
-    if (direction) {
+    if (resume && hl_resume.line == -1) {
+        /* The last pattern did not match, so this one will not either */
+    } else if (direction) {
         int start = *sel_rline;
         int end = length;
+        int first = start;
 
-        offset = *sel_col_rend;
-        while (!success) {
-            for (i = start; i < end; i++) {
-                int local_cur_line_length;
-
-                local_cur_line = (char *) tlines[i];
-                local_cur_line_length = strlen(local_cur_line);
-
-                /* Add the position of the current line's last match */
-                if (i == *sel_rline) {
-                    if (offset >= local_cur_line_length)
-                        continue;
-                    local_cur_line += offset;
-                }
+        /* Start on the line the last search matched on */
+        if (resume && hl_resume.wrapped) {
+            end = start;
+            start = 0;
+            first = hl_resume.line;
+        } else if (resume)
+            first = hl_resume.line;
 
-                /* Found a match */
-                if ((result = regexec(&t, local_cur_line, 1, pmatch, 0)) == 0) {
-                    success = 1;
-                    break;
-                }
-            }
+        while (!success) {
+            i = hl_regex_search(&pattern, get_line, data, lines, first,
+                    end - 1, 1, *sel_rline, *sel_col_rbeg, *sel_col_rend,
+                    pmatch);
+            success = (i != -1);
 
             if (success || start == 0 || !config_wrapscan) {
                 break;
             } else {
                 end = start;
                 start = 0;
+                first = start;
             }
         }
 
+        wrapped = start != *sel_rline;
     } else {                    /* Reverse search */
-        int j, pos;
         int start = *sel_rline;
         int end = 0;
+        int first = start;
 
-        offset = *sel_col_rbeg;
+        /* Start on the line the last search matched on */
+        if (resume && hl_resume.wrapped) {
+            end = start;
+            start = length - 1;
+            first = hl_resume.line;
+        } else if (resume)
+            first = hl_resume.line;
 
-        /* Try each line */
         while (!success) {
-            for (i = start; i >= end; i--) {
-                local_cur_line = (char *) tlines[i];
-                pos = strlen(local_cur_line) - 1;
-                if (pos < 0)
-                    continue;
-
-                if (i == *sel_rline)
-                    pos = offset - 1;
-
-                /* Try each line, char by char starting from the end */
-                for (j = pos; j >= 0; j--) {
-                    if ((result = regexec(&t, local_cur_line + j, 1, pmatch,
-                                            0)) == 0) {
-                        if (i == *sel_rline && pmatch[0].rm_so > pos - j)
-                            continue;
-                        /* Found a match */
-                        success = 1;
-                        offset = j;
-                        break;
-                    }
-                }
-
-                if (success)
-                    break;
-            }
+            i = hl_regex_search(&pattern, get_line, data, lines, first, end,
+                    0, *sel_rline, *sel_col_rbeg, *sel_col_rend, pmatch);
+            success = (i != -1);
 
             if (success || start == length - 1 || !config_wrapscan) {
                 break;
             } else {
                 end = start;
                 start = length - 1;
+                first = start;
             }
         }
 
+        wrapped = start != *sel_rline;
     }
 
-    if (success) {
-        /* The offset is 0 if the line was not on the original line */
-        if (direction && *sel_rline != i)
-            offset = 0;
+    /* Remember where the pattern matched, before the match moves the
+     * place the next search starts from */
+    free(hl_resume.regex);
+    hl_resume.regex = cgdb_strdup(regex);
+    hl_resume.data = data;
+    hl_resume.get_line = get_line;
+    hl_resume.length = length;
+    hl_resume.icase = icase;
+    hl_resume.direction = direction;
+    hl_resume.wrapscan = config_wrapscan;
+    hl_resume.sel_rline = *sel_rline;
+    hl_resume.sel_col_rbeg = *sel_col_rbeg;
+    hl_resume.sel_col_rend = *sel_col_rend;
+    if (!resume || hl_resume.line != -1) {
+        hl_resume.line = success ? i : -1;
+        hl_resume.wrapped = success ? wrapped : 0;
+    }
 
+    if (success) {
         /* If final match ( user hit enter ) make position perminant */
         if (opt == 2) {
-            *sel_col_rbeg = pmatch[0].rm_so + offset;
-            *sel_col_rend = pmatch[0].rm_eo + offset;
+            *sel_col_rbeg = pmatch[0].rm_so;
+            *sel_col_rend = pmatch[0].rm_eo;
             *sel_rline = i;
         }
 
         /* Keep the new line as the selected line */
         *sel_line = i;
 
-        /* If the match is not perminant then give cur_line highlighting */
-        if (opt != 2 && pmatch[0].rm_so != -1 && pmatch[0].rm_eo != -1)
-            *cur_line =
-                    highlight_line_segment(hl_lines[i],
-                    pmatch[0].rm_so + offset, pmatch[0].rm_eo + offset);
+        /* If the match is not perminant then highlight it */
+        if (opt != 2 && pmatch[0].rm_so != -1 && pmatch[0].rm_eo != -1) {
+            *match_beg = pmatch[0].rm_so;
+            *match_end = pmatch[0].rm_eo;
+        }
     } else {
         /* On failure, the current line goes to the original line */
         *sel_line = *sel_rline;
     }
 
-    regfree(&t);
-
     return success;
 }
@@ -25,30 +25,227 @@
 /* Functions */
 /* --------- */
 
-/* highlight:  Inserts the highlighting tags into the buffer.  Lines in
- * ----------  this file should be displayed with hl_wprintw from now on...
+/* highlight:  Prepares the buffer for highlighting.  Lines in this file
+ * ----------  should be displayed with hl_wprintw from now on...
+ *
+ * The highlighting of each line is kept in node->hl_spans, which is NULL for
+ * the lines that are not highlighted yet, until highlight_lines is called
+ * for them.  Any lines that were highlighted already are discarded, so this
+ * is also used when the language of the file changes.  A large file is not
+ * highlighted here, see highlight_block.
  *
  *   node:  The node containing the file buffer to highlight.
  */
 void highlight(struct list_node *node);
 
-/* hl_wprintw:  Prints a given line using the embedded highlighting commands
- * -----------  to dictate how to color the given line.
+/* highlight_reload:  Moves the highlighting of a file over to a new version
+ * -----------------  of its text.
+ *
+ * The lines that did not change keep their highlighting.  The lines that
+ * changed are lexed again, along with the lines after them whose lexer
+ * state changed, such as when a comment was opened.
+ *
+ *   node:       The node, with buf holding the new text and hl_spans still
+ *               describing the old text.
+ *   new_to_old: For each line of the new text, the line of the old text it
+ *               is the same as, or -1 if it changed.
+ *   old_length: The number of lines of the old text.
+ */
+void highlight_reload(struct list_node *node, const int *new_to_old,
+        int old_length);
+
+/* highlight_release:  Frees the highlighting of a file.
+ * ------------------
+ *
+ *   node:  The node containing the file buffer.
+ */
+void highlight_release(struct list_node *node);
+
+/* highlight_memory:  Gets the memory used by the highlighting of a file.
+ * -----------------
+ *
+ *   node:  The node containing the file buffer.
+ *
+ * Return Value: The number of bytes.
+ */
+size_t highlight_memory(struct list_node *node);
+
+/* highlight_lines:  Inserts the highlighting tags into a range of lines.
+ * ----------------
+ *
+ * Only the lines that are not highlighted yet are done.  The work needed
+ * depends on the size of the range, not the size of the file.
+ *
+ *   node:  The node containing the file buffer to highlight.
+ *   start: The first line to highlight.
+ *   end:   One past the last line to highlight.
+ *
+ * Return Value: The change in the number of bytes used by the buffer.
+ */
+long highlight_lines(struct list_node *node, int start, int end);
+
+/* highlight_block:  Highlights some lines on their own.
+ * ----------------
+ *
+ * This is used for the lines of a large file that are in memory, since the
+ * rest of the file is not.  The lexer starts in its initial state at the
+ * first line.
+ *
+ *   language: The language of the lines
+ *   lines:    The lines to highlight
+ *   count:    The number of lines
+ *   bytes:    Returns the number of bytes used by the spans
+ *
+ * Return Value: The spans of each line, or NULL if the language is not
+ *               highlighted.  This must be freed with highlight_block_free.
+ */
+struct hl_span **highlight_block(enum tokenizer_language_support language,
+        char **lines, int count, long *bytes);
+
+/* highlight_block_free:  Frees the spans from highlight_block.
+ * ---------------------
+ *
+ *   spans:  The spans of each line, or NULL
+ *   count:  The number of lines
+ */
+void highlight_block_free(struct hl_span **spans, int count);
+
+/* highlight_cache_init:  Enables the cache of highlighted files.
+ * ---------------------
+ *
+ * Files that have been highlighted completely are saved in a directory in
+ * dir, and loaded from there instead of being highlighted again as long as
+ * they have not changed.
+ *
+ *   dir:  The cgdb home directory.
+ */
+void highlight_cache_init(const char *dir);
+
+/* The worker thread highlights files in the background, so that loading a
+ * file never blocks the main loop.  When it has highlighted some lines, it
+ * writes to a pipe, and the main loop picks up the results with
+ * highlight_get_result.  Without thread support, highlight_lines is used. */
+
+struct hl_result;
+
+/* highlight_worker_start:  Starts the worker thread.
+ * -----------------------
+ *
+ * Files passed to highlight after this are highlighted by the worker.
+ *
+ * Return Value: The file descriptor that is readable when there are results,
+ *               or -1 if the worker could not be started.
+ */
+int highlight_worker_start(void);
+
+/* highlight_worker_stop:  Stops the worker thread, and drops all results.
+ * ----------------------
+ */
+void highlight_worker_stop(void);
+
+/* highlight_worker_fd:  Gets the file descriptor of the worker thread.
+ * --------------------
  *
- *   win:     The ncurses window to which the line will be written
- *   line:    The line to print
- *   width:   The maximum width of a line
- *   offset:  Character (in line) to start at (0..length-1)
+ * Return Value: The file descriptor, or -1 if the worker is not running.
  */
-void hl_wprintw(WINDOW * win, const char *line, int width, int offset);
+int highlight_worker_fd(void);
+
+/* highlight_request:  Asks the worker thread to do a range of lines first.
+ * ------------------
+ *
+ *   node:  The node containing the file buffer to highlight.
+ *   start: The first line wanted.
+ *   end:   One past the last line wanted.
+ *
+ * Return Value: Zero if the lines are done or the worker will do them, or
+ *               -1 if the worker is not highlighting the file, in which case
+ *               highlight_lines should be used.
+ */
+int highlight_request(struct list_node *node, int start, int end);
+
+/* highlight_cancel:  Stops the worker thread from highlighting a file.
+ * -----------------
+ *
+ * This must be called before the buffer of the file is released.
+ *
+ *   node:  The node containing the file buffer.
+ */
+void highlight_cancel(struct list_node *node);
+
+/* highlight_get_result:  Gets lines the worker thread has highlighted.
+ * ---------------------
+ *
+ * Return Value: The next result, or NULL if there are none.  The result
+ *               must be passed to highlight_install_result or
+ *               highlight_free_result.
+ */
+struct hl_result *highlight_get_result(void);
+
+/* highlight_result_path:  Gets the file and lines a result is for.
+ * ----------------------
+ *
+ *   r:     The result.
+ *   start: Returns the first line of the result.
+ *   end:   Returns one past the last line of the result.
+ *
+ * Return Value: The path of the file.
+ */
+const char *highlight_result_path(struct hl_result *r, int *start, int *end);
+
+/* highlight_install_result:  Stores the lines of a result in a file buffer.
+ * -------------------------
+ *
+ * Results for an older version of the buffer are dropped.  The result is
+ * freed.
+ *
+ *   node:  The node of the file the result is for.
+ *   r:     The result.
+ *
+ * Return Value: The change in the number of bytes used by the buffer.
+ */
+long highlight_install_result(struct list_node *node, struct hl_result *r);
+
+/* highlight_free_result:  Frees a result without using it.
+ * ----------------------
+ */
+void highlight_free_result(struct hl_result *r);
+
+/* hl_wprintw:  Prints a given line using its spans to dictate how to color
+ * -----------  the given line.
+ *
+ *   win:       The ncurses window to which the line will be written
+ *   line:      The line to print
+ *   spans:     The spans of the line, or NULL to print it without color
+ *   matches:   Matches of the hlsearch pattern to highlight, or NULL
+ *   width:     The maximum width of a line
+ *   offset:    Character (in line) to start at (0..length-1)
+ *   match_beg: The beginning index of a search match to highlight, or -1
+ *   match_end: The ending index of the search match, or -1
+ */
+void hl_wprintw(WINDOW * win, const char *line, const struct hl_span *spans,
+        const struct hl_match *matches, int width, int offset, int match_beg,
+        int match_end);
+
+/* hl_get_line: Gets a line for hl_regex to search.  The line only has to
+ * ------------  stay good until the next line is asked for.
+ *
+ *  data:  The data passed to hl_regex
+ *  line:  The line number
+ */
+typedef const char *(*hl_get_line) (void *data, int line);
 
 /* hl_regex: Matches a regular expression to some lines.
  * ---------
  *
  *  regex:          The regular expression to match.
- *  tlines:         The lines of text to search.
+ *  get_line:       Gets each line of text to search.
+ *  data:           Passed to get_line.
+ *  lines:          Every line, if they can all be read at once, or NULL.
+ *                  Many lines are then searched on more than one thread.
  *  length:         The number of lines.
- *  cur_line:       This line is returned with highlighting embedded into it.
+ *  match_beg:      Returns the beginning index of an incremental match on
+ *                  sel_line, or -1.
+ *  match_end:      Returns the ending index of an incremental match, or -1.
  *  sel_line:       The current line the user is on.
  *  sel_rline:      The current line the regular expression is on.
  *  sel_col_rbeg:   The beggining index of the last match.
@@ -57,10 +254,36 @@ void hl_wprintw(WINDOW * win, const char *line, int width, int offset);
  *  direction:      1 if forward, 0 if reverse
  *  icase:          1 if case insensitive, 0 otherwise
  */
-int hl_regex(const char *regex, const char **highlighted_lines, const char **tlines, const int length, char **cur_line, /* Returns the correct highlighted line */
+int hl_regex(const char *regex, hl_get_line get_line, void *data,
+        char **lines, const int length,
+        int *match_beg, int *match_end,
         int *sel_line,          /* Returns new cur line if regex matches */
         int *sel_rline,         /* Used for internal purposes */
         int *sel_col_rbeg,
         int *sel_col_rend, int opt, int direction, int icase);
 
+/* hl_regex_matches: Finds every match of a regular expression on a line.
+ * -----------------
+ *
+ * Matches that are empty are left out, since there is nothing to draw.
+ *
+ *  regex:  The regular expression
+ *  icase:  1 if case insensitive, 0 otherwise
+ *  line:   The line to search
+ *
+ * Return Value: The matches, which must be freed.  There are none if the
+ *               pattern is not valid.
+ */
+struct hl_match *hl_regex_matches(const char *regex, int icase,
+        const char *line);
+
+/* hl_regex_forget: Makes the next hl_regex on some lines search them all,
+ * ----------------  instead of starting where the last search matched.
+ *
+ * This must be called when a new search starts, or the lines change.
+ *
+ *  data:  The data passed to hl_regex
+ */
+void hl_regex_forget(const void *data);
+
 #endif /* _HIGHLIGHT_H_ */
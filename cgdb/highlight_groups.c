@@ -42,6 +42,8 @@ struct hl_groups {
     int more_colors;
   /** This is the data for each highlighting group. */
     struct hl_group_info groups[HLG_LAST];
+  /** The curses attributes of each group, indexed by kind. */
+    int attrs[HLG_LAST];
 };
 
 static struct hl_group_info *lookup_group_info_by_key(struct hl_groups *groups,
@@ -59,6 +61,29 @@ static struct hl_group_info *lookup_group_info_by_key(struct hl_groups *groups,
     return NULL;
 }
 
+/**
+ * Recompute the cached curses attributes for a group. This must be called
+ * whenever the group's attributes, its color pair or the color mode change.
+ */
+static void cache_group_attr(struct hl_groups *groups, enum hl_group_kind kind)
+{
+    struct hl_group_info *info = lookup_group_info_by_key(groups, kind);
+    int attr;
+
+    if (!info)
+        return;
+
+    if (!groups->in_color)
+        attr = info->mono_attrs;
+    else {
+        attr = info->color_attrs;
+        if (info->color_pair)
+            attr |= COLOR_PAIR(info->color_pair);
+    }
+
+    groups->attrs[kind - 1] = attr;
+}
+
 /** The global instance, this is used externally */
 hl_groups_ptr hl_groups_instance = NULL;
 
@@ -100,6 +125,7 @@ static const struct default_hl_group_info default_groups_for_curses[] = {
     {HLG_DISABLED_BREAKPOINT, A_BOLD, A_BOLD, COLOR_YELLOW, COLOR_BLACK},
     {HLG_SELECTED_LINE_NUMBER, A_BOLD, A_BOLD, COLOR_WHITE, COLOR_BLACK},
     {HLG_LOGO, A_BOLD, A_BOLD, COLOR_BLUE, COLOR_BLACK},
+    {HLG_HLSEARCH, A_REVERSE, A_NORMAL, COLOR_BLACK, COLOR_YELLOW},
     {HLG_LAST, A_NORMAL, A_NORMAL, -1, -1}
 };
 
@@ -123,6 +149,7 @@ static const struct default_hl_group_info default_groups_for_background_dark[]
     {HLG_DISABLED_BREAKPOINT, A_BOLD, A_BOLD, COLOR_YELLOW, -1},
     {HLG_SELECTED_LINE_NUMBER, A_BOLD, A_BOLD, -1, -1},
     {HLG_LOGO, A_BOLD, A_BOLD, COLOR_BLUE, -1},
+    {HLG_HLSEARCH, A_REVERSE, A_NORMAL, COLOR_BLACK, COLOR_YELLOW},
     {HLG_LAST, A_NORMAL, A_NORMAL, -1, -1}
 };
 
@@ -148,6 +175,7 @@ static struct hl_group_name hl_group_names[] = {
     {HLG_DISABLED_BREAKPOINT, "DisabledBreakpoint"},
     {HLG_SELECTED_LINE_NUMBER, "SelectedLineNr"},
     {HLG_LOGO, "Logo"},
+    {HLG_HLSEARCH, "Search"},
     {HLG_LAST, NULL}
 };
 
@@ -386,6 +414,7 @@ hl_groups_ptr hl_groups_initialize(void)
         info->mono_attrs = 0;
         info->mono_attrs = 0;
         info->color_pair = 0;
+        hl_groups->attrs[i] = 0;
     }
 
     return hl_groups;
@@ -433,6 +462,7 @@ int hl_groups_setup(hl_groups_ptr hl_groups)
 
         val = setup_group(hl_groups, spec->kind, spec->mono_attrs,
                 spec->color_attrs, spec->fore_color, spec->back_color);
+        cache_group_attr(hl_groups, spec->kind);
         if (val == -1) {
             logger_write_pos(logger, __FILE__, __LINE__, "setup group.");
             return -1;
@@ -445,18 +475,10 @@ int hl_groups_setup(hl_groups_ptr hl_groups)
 int
 hl_groups_get_attr(hl_groups_ptr hl_groups, enum hl_group_kind kind, int *attr)
 {
-    struct hl_group_info *info = lookup_group_info_by_key(hl_groups, kind);
-
-    if (!hl_groups || !info || !attr)
+    if (!hl_groups || !attr || kind < 1 || kind >= HLG_LAST)
         return -1;
 
-    if (!hl_groups->in_color)
-        *attr = info->mono_attrs;
-    else {
-        *attr = info->color_attrs;
-        if (info->color_pair)
-            *attr |= COLOR_PAIR(info->color_pair);
-    }
+    *attr = hl_groups->attrs[kind - 1];
 
     return 0;
 }
@@ -660,6 +682,7 @@ int hl_groups_parse_config(hl_groups_ptr hl_groups)
 
     val = setup_group(hl_groups, group_kind, mono_attrs, color_attrs, fg_color,
             bg_color);
+    cache_group_attr(hl_groups, group_kind);
     if (val == -1) {
         return 1;
     }
@@ -36,6 +36,10 @@
 #include <sys/ioctl.h>
 #endif /* HAVE_SYS_IOCTL_H */
 
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif /* HAVE_SYS_TIME_H */
+
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif /* HAVE_UNISTD_H */
@@ -63,6 +67,8 @@
 #include "highlight.h"
 #include "highlight_groups.h"
 #include "fs_util.h"
+#include "project.h"
+#include "sys_util.h"
 
 /* ----------- */
 /* Prototypes  */
@@ -110,10 +116,23 @@ static struct sviewer *src_win = NULL;  /* The source viewer window */
 static WINDOW *status_win = NULL;   /* The status line */
 static WINDOW *tty_status_win = NULL;   /* The tty status line */
 static enum Focus focus = GDB;  /* Which pane is currently focused */
+static int gdb_win_dirty = 0;   /* Flag: gdb window has output to draw */
+static int tty_win_dirty = 0;   /* Flag: tty window has output to draw */
+static struct timeval last_render;  /* When if_render last drew output */
 static struct winsize screen_size;  /* Screen size */
 
 struct filedlg *fd;             /* The file dialog structure */
 
+/* A project search waiting for the list of source files, or NULL */
+static char *project_regex = NULL;
+
+/* The lines the last project search found */
+static struct project_match *project_matches = NULL;
+static int project_match_count = 0;
+
+/* Flag: The file dialog shows project_matches instead of files */
+static int filedlg_matches = 0;
+
 /* The regex the user is entering */
 static struct ibuf *regex_cur = NULL;
 
@@ -127,6 +146,11 @@ static int regex_direction_last;
 /* The position of the source file, before regex was applied. */
 static int orig_line_regex;
 
+/* The GDB or TTY window the regex is for, or NULL if it is for the source
+ * window, and the focus to go back to when it is entered */
+static struct scroller *regex_scroller = NULL;
+static enum Focus regex_focus;
+
 static char last_key_pressed = 0;   /* Last key user entered in cgdb mode */
 
 /* The cgdb status bar command */
@@ -433,10 +457,13 @@ void if_draw(void)
         source_display(src_win, focus == CGDB);
 
     if (tty_win_on && get_tty_height() > 0)
-        scr_refresh(tty_win, focus == TTY);
+        scr_refresh(tty_win, focus == TTY, 1);
 
     if (get_gdb_height() > 0)
-        scr_refresh(gdb_win, focus == GDB);
+        scr_refresh(gdb_win, focus == GDB, 1);
+
+    /* Any output waiting to be drawn is on the screen now */
+    gdb_win_dirty = tty_win_dirty = 0;
 
     /* This check is here so that the cursor goes to the 
      * cgdb window. The cursor would stay in the gdb window 
@@ -490,6 +517,7 @@ static int if_layout()
                 get_gdb_width());
         if (gdb_win == NULL)
             return 2;
+        if_set_scrollback();
     } else {                    /* Resize the GDB I/O window */
         if (get_gdb_height() > 0)
             scr_move(gdb_win, get_gdb_row(), get_gdb_col(), get_gdb_height(),
@@ -503,6 +531,7 @@ static int if_layout()
                 get_tty_width());
         if (tty_win == NULL)
             return 2;
+        if_set_scrollback();
     } else {                    /* Resize the GDB I/O window */
         if (get_tty_height() > 0)
             scr_move(tty_win, get_tty_row(), get_tty_col(), get_tty_height(),
@@ -744,6 +773,58 @@ static void if_run_command(struct sviewer *sview, struct ibuf *ibuf_command)
     if_draw();
 }
 
+/* scroller_search_input: Searches the scrollback of the GDB or TTY window.
+ * ----------------------
+ *
+ * The search keys are only taken while the window is scrolled back, so
+ * that they still go to GDB, or the program, otherwise.
+ *
+ *   scr:     The scroller of the window
+ *   window:  The focus of the window
+ *   key:     Keystroke received.
+ *
+ * Return Value:    0 if the key was used, 1 if not.
+ */
+static int scroller_search_input(struct scroller *scr, enum Focus window,
+        int key)
+{
+    int regex_icase = cgdbrc_get(CGDBRC_IGNORECASE)->variant.int_val;
+    int direction;
+
+    if (scr_at_end(scr))
+        return 1;
+
+    switch (key) {
+        case '/':
+        case '?':
+            regex_cur = ibuf_init();
+            regex_direction_cur = ('/' == key);
+            regex_scroller = scr;
+            regex_focus = window;
+
+            sbc_kind = SBC_REGEX;
+            if_set_focus(CGDB_STATUS_BAR);
+
+            scr_search_regex_init(scr);
+            if_draw();
+            return 0;
+        case 'n':
+        case 'N':
+            if (regex_last != NULL) {
+                direction = (key == 'n') ? regex_direction_last :
+                        !regex_direction_last;
+                scr_search_regex_init(scr);
+                scr_search_regex(scr, ibuf_get(regex_last), 2, direction,
+                        regex_icase);
+                if_draw();
+                return 0;
+            }
+            break;
+    }
+
+    return 1;
+}
+
 /* tty_input: Handles user input to the tty I/O window.
  * ----------
  *
@@ -770,7 +851,9 @@ static int tty_input(int key)
             scr_end(tty_win);
             break;
         default:
-            return 2;
+            if (scroller_search_input(tty_win, TTY, key))
+                return 2;
+            return 0;
     }
 
     if_draw();
@@ -838,7 +921,7 @@ static int gdb_input(int key)
         }
 #endif
         default:
-            return 1;
+            return scroller_search_input(gdb_win, GDB, key);
     }
 
     if_draw();
@@ -846,6 +929,16 @@ static int gdb_input(int key)
     return 0;
 }
 
+/* regex_search: Searches the window the regex is being entered for. */
+static void regex_search(struct sviewer *sview, const char *regex, int opt,
+        int direction, int icase)
+{
+    if (regex_scroller)
+        scr_search_regex(regex_scroller, regex, opt, direction, icase);
+    else
+        source_search_regex(sview, regex, opt, direction, icase);
+}
+
 /**
  * Capture a regular expression from the user, one key at a time.
  * This modifies the global variables regex_cur and regex_last.
@@ -874,8 +967,10 @@ static int status_bar_regex_input(struct sviewer *sview, int key)
             }
             regex_last = ibuf_dup(regex_cur);
             regex_direction_last = regex_direction_cur;
-            source_search_regex(sview, ibuf_get(regex_last), 2,
+            regex_search(sview, ibuf_get(regex_last), 2,
                     regex_direction_last, regex_icase);
+            if (!regex_scroller)
+                source_set_hlsearch(sview, ibuf_get(regex_last));
             if_draw();
             done = 1;
             break;
@@ -883,10 +978,12 @@ static int status_bar_regex_input(struct sviewer *sview, int key)
         case 127:
             /* Backspace or DEL key */
             if (ibuf_length(regex_cur) == 0) {
+                if (regex_scroller)
+                    scr_search_regex_cancel(regex_scroller);
                 done = 1;
             } else {
                 ibuf_delchar(regex_cur);
-                source_search_regex(sview, ibuf_get(regex_cur), 1,
+                regex_search(sview, ibuf_get(regex_cur), 1,
                         regex_direction_cur, regex_icase);
                 if_draw();
                 update_status_win();
@@ -902,7 +999,7 @@ static int status_bar_regex_input(struct sviewer *sview, int key)
             } else {
                 ibuf_addchar(regex_cur, key);
             }
-            source_search_regex(sview, ibuf_get(regex_cur), 1,
+            regex_search(sview, ibuf_get(regex_cur), 1,
                     regex_direction_cur, regex_icase);
             if_draw();
             update_status_win();
@@ -911,7 +1008,8 @@ static int status_bar_regex_input(struct sviewer *sview, int key)
     if (done) {
         ibuf_free(regex_cur);
         regex_cur = NULL;
-        if_set_focus(CGDB);
+        if_set_focus(regex_scroller ? regex_focus : CGDB);
+        regex_scroller = NULL;
     }
 
     return 0;
@@ -1006,7 +1104,7 @@ toggle_breakpoint(struct sviewer *sview, enum tgdb_breakpoint_action t)
         path = sview->cur->path;
 
     /* delete an existing breakpoint */
-    if (sview->cur->buf.breakpts[line])
+    if (source_get_break(sview, line))
         t = TGDB_BREAKPOINT_DELETE;
 
     request_ptr = tgdb_request_modify_breakpoint(tgdb, path, line + 1, t);
@@ -1206,11 +1304,20 @@ int internal_if_input(int key)
         if (focus == CGDB_STATUS_BAR && sbc_kind == SBC_NORMAL) {
             ibuf_free(cur_sbc);
             cur_sbc = NULL;
+        } else if (focus == CGDB_STATUS_BAR && sbc_kind == SBC_REGEX &&
+                regex_scroller) {
+            /* Go back to the window that was being searched */
+            ibuf_free(regex_cur);
+            regex_cur = NULL;
+            scr_search_regex_cancel(regex_scroller);
+            if_set_focus(regex_focus);
+            regex_scroller = NULL;
+            return 0;
         } else if (focus == CGDB_STATUS_BAR && sbc_kind == SBC_REGEX) {
             ibuf_free(regex_cur);
             regex_cur = NULL;
-            free(src_win->cur->buf.cur_line);
-            src_win->cur->buf.cur_line = NULL;
+            src_win->cur->buf.match_beg = -1;
+            src_win->cur->buf.match_end = -1;
             src_win->cur->sel_rline = orig_line_regex;
             src_win->cur->sel_line = orig_line_regex;
         }
@@ -1259,11 +1366,13 @@ int internal_if_input(int key)
                 case 'n':
                     source_search_regex(src_win, ibuf_get(regex_last), 2,
                             regex_direction_last, regex_icase);
+                    source_set_hlsearch(src_win, ibuf_get(regex_last));
                     if_draw();
                     break;
                 case 'N':
                     source_search_regex(src_win, ibuf_get(regex_last), 2,
                             !regex_direction_last, regex_icase);
+                    source_set_hlsearch(src_win, ibuf_get(regex_last));
                     if_draw();
                     break;
                 case 'T':
@@ -1367,6 +1476,18 @@ int internal_if_input(int key)
             } else if (ret == 0) {
                 return 0;
                 /* The user picked a file */
+            } else if (ret == 1 && filedlg_matches) {
+                struct project_match *match =
+                        &project_matches[filedlg_get_selection(fd)];
+
+                if_set_focus(CGDB);
+                if (source_set_exec_line(src_win, match->path, 0) == 0) {
+                    source_set_sel_line(src_win, match->line);
+                    if_draw();
+                } else
+                    if_display_message("No such file:", 0, " %s",
+                            match->path);
+                return 0;
             } else if (ret == 1) {
                 tgdb_request_ptr request_ptr;
 
@@ -1403,12 +1524,10 @@ void if_tty_print(const char *buf)
     scr_add(tty_win, buf);
 
     /* Only need to redraw if tty_win is being displayed */
-    if (tty_win_on && get_gdb_height() > 0) {
-        scr_refresh(tty_win, focus == TTY);
-
-        /* Make sure cursor reappears in source window if focus is there */
-        if (focus == CGDB)
-            wrefresh(src_win->win);
+    if (tty_win_on && get_tty_height() > 0) {
+        tty_win_dirty = 1;
+        if (cgdbrc_get(CGDBRC_REFRESHRATE)->variant.int_val == 0)
+            if_render();
     }
 }
 
@@ -1418,14 +1537,57 @@ void if_print(const char *buf)
     scr_add(gdb_win, buf);
 
     if (get_gdb_height() > 0) {
-        scr_refresh(gdb_win, focus == GDB);
-
-        /* Make sure cursor reappears in source window if focus is there */
-        if (focus == CGDB)
-            wrefresh(src_win->win);
+        gdb_win_dirty = 1;
+        if (cgdbrc_get(CGDBRC_REFRESHRATE)->variant.int_val == 0)
+            if_render();
     }
 }
 
+int if_render_timeout(void)
+{
+    int rate = cgdbrc_get(CGDBRC_REFRESHRATE)->variant.int_val;
+    struct timeval now;
+    long elapsed;
+
+    /* The file dialog covers the windows, they are drawn when it closes */
+    if ((!gdb_win_dirty && !tty_win_dirty) || focus == FILE_DLG)
+        return -1;
+
+    if (rate <= 0 || rate > 1000)
+        return 0;
+
+    gettimeofday(&now, NULL);
+    elapsed = (now.tv_sec - last_render.tv_sec) * 1000 +
+            (now.tv_usec - last_render.tv_usec) / 1000;
+
+    /* The clock may have been set back */
+    if (elapsed < 0 || elapsed >= 1000 / rate)
+        return 0;
+
+    return 1000 / rate - elapsed;
+}
+
+void if_render(void)
+{
+    if ((!gdb_win_dirty && !tty_win_dirty) || focus == FILE_DLG)
+        return;
+
+    if (tty_win_dirty && tty_win_on && get_tty_height() > 0)
+        scr_refresh(tty_win, focus == TTY, 0);
+
+    if (gdb_win_dirty && get_gdb_height() > 0)
+        scr_refresh(gdb_win, focus == GDB, 0);
+
+    /* Make sure cursor reappears in source window if focus is there */
+    if (focus == CGDB)
+        wnoutrefresh(src_win->win);
+
+    doupdate();
+
+    gdb_win_dirty = tty_win_dirty = 0;
+    gettimeofday(&last_render, NULL);
+}
+
 void if_print_message(const char *fmt, ...)
 {
     va_list ap;
@@ -1470,6 +1632,8 @@ struct sviewer *if_get_sview()
 void if_clear_filedlg(void)
 {
     filedlg_clear(fd);
+    filedlg_set_label(fd, NULL);
+    filedlg_matches = 0;
 }
 
 void if_add_filedlg_choice(const char *filename)
@@ -1482,6 +1646,84 @@ void if_filedlg_display_message(char *message)
     filedlg_display_message(fd, message);
 }
 
+void if_project_search(const char *regex)
+{
+    extern int kui_input_acceptable;
+    tgdb_request_ptr request_ptr;
+
+    free(project_regex);
+    project_regex = cgdb_strdup(regex);
+
+    /* The files are asked for every time, more may have been loaded */
+    kui_input_acceptable = 0;
+    request_ptr = tgdb_request_inferiors_source_files(tgdb);
+    handle_request(tgdb, request_ptr);
+}
+
+int if_project_search_files(void)
+{
+    int icase = cgdbrc_get(CGDBRC_IGNORECASE)->variant.int_val;
+    char label[MAX_LINE];
+    int count, i;
+
+    if (!project_regex)
+        return 0;
+
+    project_free_matches(project_matches, project_match_count);
+    project_matches = NULL;
+    project_match_count = 0;
+
+    count = project_search(project_regex, icase, &project_matches);
+
+    if (count == -1)
+        if_display_message("Invalid pattern:", 0, " %s", project_regex);
+    else if (count == 0)
+        if_display_message("Pattern not found:", 0, " %s", project_regex);
+    else {
+        project_match_count = count;
+        if_clear_filedlg();
+
+        for (i = 0; i < count; i++) {
+            struct project_match *match = &project_matches[i];
+            const char *text = match->text;
+            char choice[MAX_LINE], *c;
+
+            while (*text == ' ' || *text == '\t')
+                text++;
+
+            /* Long lines are cut, the selected choice must fit in
+             * filedlg_file */
+            snprintf(choice, sizeof (choice), "%s:%d: %s", match->path,
+                    match->line, text);
+
+            /* The file dialog draws a character per column */
+            for (c = choice; *c; c++)
+                if (*c == '\t')
+                    *c = ' ';
+
+            filedlg_add_choice(fd, choice);
+        }
+
+        snprintf(label, sizeof (label),
+                "%d lines match %s. Select one or press q to cancel.",
+                count, project_regex);
+        filedlg_set_label(fd, label);
+        filedlg_matches = 1;
+        if_set_focus(FILE_DLG);
+    }
+
+    free(project_regex);
+    project_regex = NULL;
+
+    return 1;
+}
+
+void if_project_search_cancel(void)
+{
+    free(project_regex);
+    project_regex = NULL;
+}
+
 void if_shutdown(void)
 {
     /* Shut down curses cleanly */
@@ -1506,6 +1748,10 @@ void if_shutdown(void)
 
 void if_set_focus(Focus f)
 {
+    /* The file dialog was drawn over the source window */
+    if (focus == FILE_DLG && f != FILE_DLG && src_win)
+        source_damage(src_win);
+
     switch (f) {
         case GDB:
             focus = f;
@@ -1555,6 +1801,37 @@ void if_highlight_sviewer(enum tokenizer_language_support l)
     }
 }
 
+void if_highlight_ready(void)
+{
+    if (src_win && source_highlight_ready(src_win))
+        if_draw();
+}
+
+void if_set_scrollback(void)
+{
+    if (gdb_win)
+        scr_set_scrollback(gdb_win,
+                cgdbrc_get(CGDBRC_GDBSCROLLBACK)->variant.int_val);
+
+    if (tty_win)
+        scr_set_scrollback(tty_win,
+                cgdbrc_get(CGDBRC_TTYSCROLLBACK)->variant.int_val);
+}
+
+void if_nohlsearch(void)
+{
+    if (src_win)
+        source_set_hlsearch(src_win, NULL);
+
+    if (gdb_win)
+        scr_nohlsearch(gdb_win);
+
+    if (tty_win)
+        scr_nohlsearch(tty_win);
+
+    if_draw();
+}
+
 int if_change_winminheight(int value)
 {
     if (value < 0)
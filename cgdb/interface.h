@@ -69,6 +69,22 @@ void if_print_message(const char *fmt, ...);
  */
 void if_tty_print(const char *buf);
 
+/* if_render_timeout: Gets how long the output printed to the gdb and tty
+ * ------------------  windows can wait before it is drawn.
+ *
+ * The output is drawn at most refreshrate times a second, so that a lot of
+ * output does not have to be drawn as it arrives.
+ *
+ * Return Value: The time in milliseconds until if_render should be called,
+ *               0 if it should be called now, or -1 if nothing is waiting.
+ */
+int if_render_timeout(void);
+
+/* if_render: Draws the output printed to the gdb and tty windows since the
+ * ----------  last time, updating the terminal once.
+ */
+void if_render(void);
+
 /* if_show_file: Displays the requested file in the source display window.
  * -------------
  *
@@ -116,6 +132,30 @@ void if_add_filedlg_choice(const char *filename);
  */
 void if_filedlg_display_message(char *message);
 
+/* if_project_search: Searches every source file for a pattern.
+ * ------------------
+ *
+ * GDB is asked for the list of source files first, and the search is done
+ * by if_project_search_files when the list arrives.
+ *
+ * regex: The pattern to search for
+ */
+void if_project_search(const char *regex);
+
+/* if_project_search_files: Finishes the project search that is waiting.
+ * ------------------------
+ *
+ * The lines that match are shown in the file dialog, to pick one from.
+ *
+ * Return Value: 1 if a search was waiting, 0 otherwise.
+ */
+int if_project_search_files(void);
+
+/* if_project_search_cancel: Drops the project search that is waiting.
+ * -------------------------
+ */
+void if_project_search_cancel(void);
+
 /* if_shutdown: Cleans up, and restores the terminal (shuts off curses).
  * ------------
  */
@@ -178,6 +218,30 @@ void if_set_winsplit(WIN_SPLIT_TYPE newSplit);
  */
 void if_highlight_sviewer(enum tokenizer_language_support l);
 
+/* if_highlight_ready:
+ * -------------------
+ *
+ *  Picks up the lines the highlight worker has finished, and redraws the
+ *  source viewer if any of them are visible.
+ */
+void if_highlight_ready(void);
+
+/* if_set_scrollback:
+ * ------------------
+ *
+ * Sets the number of lines the GDB and TTY windows keep to the
+ * gdbscrollback and ttyscrollback options.
+ */
+void if_set_scrollback(void);
+
+/* if_nohlsearch:
+ * --------------
+ *
+ * Stops highlighting the matches of the last search, in the source window
+ * and in the GDB and TTY windows, until the next search.
+ */
+void if_nohlsearch(void);
+
 /* if_change_winminheight:
  * -----------------------
  * 
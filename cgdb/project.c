@@ -0,0 +1,749 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+/* System Includes */
+#if HAVE_CTYPE_H
+#include <ctype.h>
+#endif /* HAVE_CTYPE_H */
+
+#if HAVE_STDIO_H
+#include <stdio.h>
+#endif /* HAVE_STDIO_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif /* HAVE_SYS_TYPES_H */
+
+#if HAVE_REGEX_H
+#include <regex.h>
+#endif /* HAVE_REGEX_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_SIGNAL_H
+#include <signal.h>
+#endif /* HAVE_SIGNAL_H */
+
+#if HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif /* HAVE_SYS_STAT_H */
+
+#if HAVE_PTHREAD_H && HAVE_LIBPTHREAD
+#include <pthread.h>
+#define PROJECT_WORKER 1
+#endif /* HAVE_PTHREAD_H && HAVE_LIBPTHREAD */
+
+/* Local Includes */
+#include "project.h"
+#include "sys_util.h"
+#include "fs_util.h"
+#include "std_hash.h"
+#include "search.h"
+
+/* The index is kept in this directory in the cgdb home directory, in a
+ * file named after a hash of the working directory. */
+#define PROJECT_DIR "project"
+
+/* Change this when the format of the index file changes */
+#define PROJECT_MAGIC "CGDBPX1"
+
+/* The bitmap of a file has a bit for about every two bytes of the file,
+ * rounded up to a power of two, and no fewer or more bits than these. */
+#define PROJECT_MIN_BITS 1024
+#define PROJECT_MAX_BITS (1 << 20)
+
+/* Files bigger than this are not searched */
+#define PROJECT_MAX_FILE_SIZE (64 * 1024 * 1024)
+
+/* A search stops after finding this many lines */
+#define PROJECT_MAX_MATCHES 10000
+
+/* The start of the index file. It is followed by each file: its struct
+ * project_entry, its path, and its bitmap. */
+struct project_header {
+    char magic[8];
+    int count;                  /* The number of files */
+};
+
+/* A file in the index file */
+struct project_entry {
+    long long size;
+    long long mtime;
+    int path_length;            /* The length of the path, without a NUL */
+    int nbits;                  /* The number of bits in the bitmap */
+};
+
+/* A file to search */
+struct project_file {
+    char *path;
+    long long size;             /* The size of the file when indexed */
+    long long mtime;            /* Its modification time when indexed */
+    int nbits;                  /* The number of bits, 0 if not indexed */
+    unsigned char *bits;        /* A bit for every trigram in the file */
+};
+
+/* The files, sorted by path. The mutex protects them, and the variables
+ * below it. */
+static struct project_file *project_files = NULL;
+static int project_count = 0;
+
+#if PROJECT_WORKER
+static pthread_mutex_t project_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t project_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t project_thread;
+static int project_running = 0; /* The worker thread was started */
+static int project_quit = 0;    /* The worker thread should exit */
+static int project_pending = 0; /* The files changed since it checked */
+#endif /* PROJECT_WORKER */
+
+static int project_changed = 0; /* The index differs from the index file */
+
+/* The index file, or empty if there is none */
+static char project_index_file[FSUTIL_PATH_MAX];
+
+static void project_lock(void)
+{
+#if PROJECT_WORKER
+    pthread_mutex_lock(&project_mutex);
+#endif /* PROJECT_WORKER */
+}
+
+static void project_unlock(void)
+{
+#if PROJECT_WORKER
+    pthread_mutex_unlock(&project_mutex);
+#endif /* PROJECT_WORKER */
+}
+
+/* project_trigram: Gets the trigram of three characters, ignoring case. */
+static unsigned int project_trigram(const char *s)
+{
+    return (tolower((unsigned char) s[0]) << 16) |
+            (tolower((unsigned char) s[1]) << 8) |
+            tolower((unsigned char) s[2]);
+}
+
+/* project_bit: Gets the bit of a trigram in a bitmap of nbits bits. */
+static unsigned int project_bit(unsigned int trigram, int nbits)
+{
+    unsigned int hash = trigram * 2654435761u;
+
+    return (hash ^ (hash >> 15)) & (nbits - 1);
+}
+
+/* project_index: Builds the bitmap of a file.
+ * --------------
+ *
+ *   text:   The contents of the file
+ *   size:   The size of text
+ *   nbits:  Set to the number of bits in the bitmap
+ *
+ * Return Value: The bitmap, which must be freed.
+ */
+static unsigned char *project_index(const char *text, long long size,
+        int *nbits)
+{
+    unsigned char *bits;
+    long long i;
+    int n = PROJECT_MIN_BITS;
+
+    while (n < size / 2 && n < PROJECT_MAX_BITS)
+        n *= 2;
+
+    bits = cgdb_malloc(n / 8);
+    memset(bits, 0, n / 8);
+
+    for (i = 0; i + 2 < size; i++) {
+        unsigned int bit = project_bit(project_trigram(text + i), n);
+
+        bits[bit / 8] |= 1 << (bit % 8);
+    }
+
+    *nbits = n;
+    return bits;
+}
+
+/* project_has: Checks if a bitmap has the bits of some trigrams. */
+static int project_has(const unsigned char *bits, int nbits,
+        const unsigned int *trigrams, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        unsigned int bit = project_bit(trigrams[i], nbits);
+
+        if (!(bits[bit / 8] & (1 << (bit % 8))))
+            return 0;
+    }
+
+    return 1;
+}
+
+/* project_find: Finds a file in project_files.
+ * -------------
+ *
+ * Return Value: The file, or NULL if it is not there.
+ */
+static struct project_file *project_find(const char *path)
+{
+    int lo = 0, hi = project_count - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(path, project_files[mid].path);
+
+        if (cmp == 0)
+            return &project_files[mid];
+        else if (cmp < 0)
+            hi = mid - 1;
+        else
+            lo = mid + 1;
+    }
+
+    return NULL;
+}
+
+/* project_store: Sets the bitmap of a file, which takes bits.
+ * --------------
+ *
+ * The caller must hold the lock. If the file is no longer searched, the
+ * bitmap is freed.
+ */
+static void project_store(const char *path, struct stat *st,
+        unsigned char *bits, int nbits)
+{
+    struct project_file *file = project_find(path);
+
+    if (!file) {
+        free(bits);
+        return;
+    }
+
+    free(file->bits);
+    file->bits = bits;
+    file->nbits = nbits;
+    file->size = st->st_size;
+    file->mtime = st->st_mtime;
+    project_changed = 1;
+}
+
+/* project_read: Reads a file.
+ * -------------
+ *
+ *   path:  The file
+ *   st:    Set to the status of the file that was read
+ *
+ * Return Value: The contents of the file, ending in a NUL, or NULL if it
+ *               could not be read.  This must be freed.
+ */
+static char *project_read(const char *path, struct stat *st)
+{
+    FILE *fp;
+    char *text;
+
+    fp = fopen(path, "rb");
+    if (!fp)
+        return NULL;
+
+    if (fstat(fileno(fp), st) == -1 || !S_ISREG(st->st_mode) ||
+            st->st_size > PROJECT_MAX_FILE_SIZE) {
+        fclose(fp);
+        return NULL;
+    }
+
+    text = cgdb_malloc(st->st_size + 1);
+    if (st->st_size > 0 && fread(text, st->st_size, 1, fp) != 1) {
+        free(text);
+        fclose(fp);
+        return NULL;
+    }
+
+    text[st->st_size] = '\0';
+    fclose(fp);
+
+    return text;
+}
+
+/* project_file_free: Frees the contents of a file. */
+static void project_file_free(struct project_file *file)
+{
+    free(file->path);
+    free(file->bits);
+}
+
+/* project_file_compare: Orders files by path. */
+static int project_file_compare(const void *a, const void *b)
+{
+    const struct project_file *fa = a, *fb = b;
+
+    return strcmp(fa->path, fb->path);
+}
+
+/* project_load: Reads the index file into project_files.
+ * -------------
+ *
+ * The files in it are searched until project_set_files is called.
+ */
+static void project_load(void)
+{
+    struct project_header header;
+    struct project_entry entry;
+    FILE *fp;
+    int i;
+
+    fp = fopen(project_index_file, "rb");
+    if (!fp)
+        return;
+
+    if (fread(&header, sizeof (header), 1, fp) != 1 ||
+            strncmp(header.magic, PROJECT_MAGIC, sizeof (header.magic)) ||
+            header.count < 0) {
+        fclose(fp);
+        return;
+    }
+
+    for (i = 0; i < header.count; i++) {
+        struct project_file file;
+
+        if (fread(&entry, sizeof (entry), 1, fp) != 1 ||
+                entry.path_length <= 0 ||
+                entry.path_length >= FSUTIL_PATH_MAX ||
+                entry.nbits < PROJECT_MIN_BITS ||
+                entry.nbits > PROJECT_MAX_BITS ||
+                (entry.nbits & (entry.nbits - 1)) != 0)
+            break;
+
+        file.path = cgdb_malloc(entry.path_length + 1);
+        file.bits = cgdb_malloc(entry.nbits / 8);
+        if (fread(file.path, entry.path_length, 1, fp) != 1 ||
+                fread(file.bits, entry.nbits / 8, 1, fp) != 1) {
+            project_file_free(&file);
+            break;
+        }
+
+        file.path[entry.path_length] = '\0';
+        file.size = entry.size;
+        file.mtime = entry.mtime;
+        file.nbits = entry.nbits;
+
+        project_files = cgdb_realloc(project_files,
+                sizeof (struct project_file) * (project_count + 1));
+        project_files[project_count++] = file;
+    }
+
+    fclose(fp);
+
+    qsort(project_files, project_count, sizeof (struct project_file),
+            project_file_compare);
+}
+
+/* project_save: Writes the files that are indexed to the index file.
+ * -------------
+ *
+ * The caller must not hold the lock.  The files are copied under the lock,
+ * and written without it, so that the main thread does not wait for the
+ * disk.  The file is written under a temporary name first, so that a
+ * partly written file is never loaded.
+ */
+static void project_save(void)
+{
+    char tmp[FSUTIL_PATH_MAX + 8];
+    struct project_header header;
+    struct project_entry entry;
+    struct project_file *files;
+    FILE *fp;
+    int i, count = 0, error = 0;
+
+    if (!project_index_file[0])
+        return;
+
+    project_lock();
+    if (!project_changed) {
+        project_unlock();
+        return;
+    }
+
+    files = cgdb_malloc(sizeof (struct project_file) * (project_count + 1));
+    for (i = 0; i < project_count; i++) {
+        struct project_file *file = &project_files[i];
+
+        if (!file->nbits)
+            continue;
+
+        files[count] = *file;
+        files[count].path = cgdb_strdup(file->path);
+        files[count].bits = cgdb_malloc(file->nbits / 8);
+        memcpy(files[count].bits, file->bits, file->nbits / 8);
+        count++;
+    }
+    project_changed = 0;
+    project_unlock();
+
+    sprintf(tmp, "%s.tmp", project_index_file);
+    fp = fopen(tmp, "wb");
+    if (!fp)
+        error = 1;
+
+    memset(&header, 0, sizeof (header));
+    memcpy(header.magic, PROJECT_MAGIC, sizeof (header.magic));
+    header.count = count;
+
+    if (!error && fwrite(&header, sizeof (header), 1, fp) != 1)
+        error = 1;
+
+    for (i = 0; i < count && !error; i++) {
+        struct project_file *file = &files[i];
+
+        memset(&entry, 0, sizeof (entry));
+        entry.size = file->size;
+        entry.mtime = file->mtime;
+        entry.path_length = strlen(file->path);
+        entry.nbits = file->nbits;
+
+        if (fwrite(&entry, sizeof (entry), 1, fp) != 1 ||
+                fwrite(file->path, entry.path_length, 1, fp) != 1 ||
+                fwrite(file->bits, file->nbits / 8, 1, fp) != 1)
+            error = 1;
+    }
+
+    for (i = 0; i < count; i++)
+        project_file_free(&files[i]);
+    free(files);
+
+    if (fp && fclose(fp) != 0)
+        error = 1;
+
+    if (error || rename(tmp, project_index_file) == -1) {
+        if (fp)
+            unlink(tmp);
+
+        /* Try again next time */
+        project_lock();
+        project_changed = 1;
+        project_unlock();
+    }
+}
+
+#if PROJECT_WORKER
+/* project_worker: Indexes the files that are new or changed.
+ * ---------------
+ *
+ * Each time the files are set, the worker goes through them once, and
+ * saves the index when it is done.
+ */
+static void *project_worker(void *arg)
+{
+    while (1) {
+        char **paths;
+        int count, i;
+
+        pthread_mutex_lock(&project_mutex);
+        while (!project_pending && !project_quit)
+            pthread_cond_wait(&project_cond, &project_mutex);
+
+        if (project_quit) {
+            pthread_mutex_unlock(&project_mutex);
+            break;
+        }
+
+        project_pending = 0;
+        count = project_count;
+        paths = cgdb_malloc(sizeof (char *) * (count + 1));
+        for (i = 0; i < count; i++)
+            paths[i] = cgdb_strdup(project_files[i].path);
+        pthread_mutex_unlock(&project_mutex);
+
+        for (i = 0; i < count; i++) {
+            struct project_file *file;
+            struct stat st;
+            unsigned char *bits;
+            char *text;
+            int nbits, current, quit;
+
+            if (stat(paths[i], &st) == -1)
+                continue;
+
+            pthread_mutex_lock(&project_mutex);
+            file = project_find(paths[i]);
+            current = !file || (file->nbits && file->size == st.st_size &&
+                    file->mtime == st.st_mtime);
+            quit = project_quit;
+            pthread_mutex_unlock(&project_mutex);
+
+            if (quit)
+                break;
+
+            if (current || !(text = project_read(paths[i], &st)))
+                continue;
+
+            bits = project_index(text, st.st_size, &nbits);
+            free(text);
+
+            pthread_mutex_lock(&project_mutex);
+            project_store(paths[i], &st, bits, nbits);
+            pthread_mutex_unlock(&project_mutex);
+        }
+
+        for (i = 0; i < count; i++)
+            free(paths[i]);
+        free(paths);
+
+        project_save();
+    }
+
+    return NULL;
+}
+#endif /* PROJECT_WORKER */
+
+void project_init(const char *dir)
+{
+    char cwd[FSUTIL_PATH_MAX], dirname[FSUTIL_PATH_MAX], name[32];
+#if PROJECT_WORKER
+    sigset_t all, old;
+#endif /* PROJECT_WORKER */
+
+    project_index_file[0] = 0;
+
+    if (getcwd(cwd, sizeof (cwd)) &&
+            fs_util_create_dir_in_base(dir, PROJECT_DIR)) {
+        fs_util_get_path(dir, PROJECT_DIR, dirname);
+        sprintf(name, "%08x.idx", std_str_hash(cwd));
+        fs_util_get_path(dirname, name, project_index_file);
+        project_load();
+    }
+
+#if PROJECT_WORKER
+    /* Signals are handled by the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    project_running =
+            pthread_create(&project_thread, NULL, project_worker, NULL) == 0;
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+#endif /* PROJECT_WORKER */
+}
+
+void project_shutdown(void)
+{
+    int i;
+
+#if PROJECT_WORKER
+    if (project_running) {
+        pthread_mutex_lock(&project_mutex);
+        project_quit = 1;
+        pthread_cond_signal(&project_cond);
+        pthread_mutex_unlock(&project_mutex);
+
+        pthread_join(project_thread, NULL);
+        project_running = 0;
+    }
+#endif /* PROJECT_WORKER */
+
+    project_save();
+
+    for (i = 0; i < project_count; i++)
+        project_file_free(&project_files[i]);
+    free(project_files);
+    project_files = NULL;
+    project_count = 0;
+}
+
+void project_set_files(char **files, int count)
+{
+    struct project_file *list;
+    int i, n = 0;
+
+    list = cgdb_malloc(sizeof (struct project_file) * (count + 1));
+    for (i = 0; i < count; i++) {
+        list[i].path = cgdb_strdup(files[i]);
+        list[i].size = list[i].mtime = 0;
+        list[i].nbits = 0;
+        list[i].bits = NULL;
+    }
+
+    qsort(list, count, sizeof (struct project_file), project_file_compare);
+
+    project_lock();
+
+    /* Keep the bitmaps of the files that were already indexed */
+    for (i = 0; i < count; i++) {
+        struct project_file *file;
+
+        if (n > 0 && strcmp(list[i].path, list[n - 1].path) == 0) {
+            free(list[i].path);
+            continue;
+        }
+
+        list[n] = list[i];
+        file = project_find(list[n].path);
+        if (file && file->nbits) {
+            list[n].size = file->size;
+            list[n].mtime = file->mtime;
+            list[n].nbits = file->nbits;
+            list[n].bits = file->bits;
+            file->nbits = 0;
+            file->bits = NULL;
+        }
+        n++;
+    }
+
+    for (i = 0; i < project_count; i++)
+        project_file_free(&project_files[i]);
+    free(project_files);
+
+    project_files = list;
+    project_count = n;
+    project_changed = 1;
+
+#if PROJECT_WORKER
+    project_pending = 1;
+    pthread_cond_signal(&project_cond);
+#endif /* PROJECT_WORKER */
+
+    project_unlock();
+}
+
+/* project_search_file: Finds the lines that match in a file.
+ * --------------------
+ *
+ *   pattern:  What to look for
+ *   path:     The file
+ *   text:     The contents of the file, which is changed
+ *   matches:  The lines that matched so far, which are added to
+ *   count:    The number of lines in matches
+ */
+static void project_search_file(struct search_pattern *pattern,
+        const char *path, char *text, struct project_match **matches,
+        int *count)
+{
+    char *line = text, *end;
+    regmatch_t pmatch[1];
+    int number;
+
+    for (number = 1; line && *count < PROJECT_MAX_MATCHES; number++) {
+        end = strchr(line, '\n');
+        if (end) {
+            *end = '\0';
+            if (end > line && end[-1] == '\r')
+                end[-1] = '\0';
+        }
+
+        if (search_first(pattern, line, pmatch)) {
+            struct project_match *m;
+
+            *matches = cgdb_realloc(*matches,
+                    sizeof (struct project_match) * (*count + 1));
+            m = &(*matches)[(*count)++];
+            m->path = cgdb_strdup(path);
+            m->line = number;
+            m->text = cgdb_strdup(line);
+        }
+
+        line = end ? end + 1 : NULL;
+    }
+}
+
+int project_search(const char *regex, int icase,
+        struct project_match **matches)
+{
+    struct search_pattern pattern, literal;
+    unsigned int *trigrams = NULL;
+    int ntrigrams = 0;
+    int cflags = icase ? REG_ICASE : 0;
+    regex_t t;
+    int count = 0, i;
+
+    *matches = NULL;
+
+    if (regcomp(&t, regex, cflags) != 0)
+        return -1;
+
+    search_pattern_init(&pattern, &t, regex, cflags);
+
+    /* The trigrams of the text every match starts with. The bitmaps are
+     * built ignoring case, so this works for either kind of search. */
+    search_pattern_init(&literal, NULL, regex, 0);
+    if (literal.literal && literal.length >= 3) {
+        ntrigrams = literal.length - 2;
+        trigrams = cgdb_malloc(sizeof (unsigned int) * ntrigrams);
+        for (i = 0; i < ntrigrams; i++)
+            trigrams[i] = project_trigram(literal.literal + i);
+    }
+
+    /* The worker may not have looked at the files since they were set, so
+     * a bitmap is only trusted while the file's size and mtime match it.
+     * A file that changed, or was not indexed yet, is read and indexed. */
+    for (i = 0; i < project_count && count < PROJECT_MAX_MATCHES; i++) {
+        struct project_file *file;
+        struct stat st;
+        char *path, *text;
+        int indexed, skip, missing;
+
+        project_lock();
+        path = cgdb_strdup(project_files[i].path);
+        project_unlock();
+
+        /* The file is looked at without the lock, which the worker may be
+         * holding.  Only this thread changes project_files itself. */
+        missing = stat(path, &st) == -1;
+
+        project_lock();
+        file = &project_files[i];
+        if (file->nbits && (missing || file->size != st.st_size ||
+                        file->mtime != st.st_mtime)) {
+            free(file->bits);
+            file->bits = NULL;
+            file->nbits = 0;
+        }
+        indexed = file->nbits != 0;
+        skip = indexed && !project_has(file->bits, file->nbits, trigrams,
+                ntrigrams);
+        project_unlock();
+
+        if (skip || !(text = project_read(path, &st))) {
+            free(path);
+            continue;
+        }
+
+        if (!indexed) {
+            unsigned char *bits;
+            int nbits;
+
+            bits = project_index(text, st.st_size, &nbits);
+            project_lock();
+            project_store(path, &st, bits, nbits);
+            project_unlock();
+        }
+
+        project_search_file(&pattern, path, text, matches, &count);
+        free(text);
+        free(path);
+    }
+
+    free(trigrams);
+    regfree(&t);
+
+    return count;
+}
+
+void project_free_matches(struct project_match *matches, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        free(matches[i].path);
+        free(matches[i].text);
+    }
+
+    free(matches);
+}
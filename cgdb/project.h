@@ -0,0 +1,77 @@
+/* project.h:
+ * ----------
+ *
+ * Searches every source file of the debugged program.  The files are the
+ * ones GDB lists with "info sources".  Each file has a trigram index: a
+ * bitmap with a bit set for every three characters in a row in the file,
+ * ignoring case.  A search only reads the files whose bitmap has every
+ * trigram of the text the pattern has to match.
+ *
+ * The index is built by a thread in the background, kept in a file in the
+ * cgdb home directory, and only built again for files whose size or
+ * modification time changed.
+ */
+
+#ifndef _PROJECT_H_
+#define _PROJECT_H_
+
+/* A line that matched a project search */
+struct project_match {
+    char *path;                 /* The file */
+    int line;                   /* The line number, starting at 1 */
+    char *text;                 /* The text of the line */
+};
+
+/* project_init:  Loads the index of the files searched before.
+ * -------------
+ *
+ * The index is kept in a directory in dir, in a file for the working
+ * directory cgdb was started in.
+ *
+ *   dir:  The cgdb home directory.
+ */
+void project_init(const char *dir);
+
+/* project_shutdown:  Stops indexing, and frees the index.
+ * -----------------
+ */
+void project_shutdown(void);
+
+/* project_set_files:  Sets the files to search.
+ * ------------------
+ *
+ * The files that are new, or changed since they were indexed, are indexed
+ * in the background.
+ *
+ *   files:  The paths of the files
+ *   count:  The number of files
+ */
+void project_set_files(char **files, int count);
+
+/* project_search:  Finds the lines that match a pattern in every file.
+ * ---------------
+ *
+ * A file's index is only used while its size and mtime are the ones it was
+ * built from.  Files that changed, or have not been indexed yet, are read,
+ * indexed and searched.
+ *
+ *   regex:    The regular expression
+ *   icase:    1 if case insensitive, 0 otherwise
+ *   matches:  Set to the lines that matched, in the order of the files.
+ *             This must be freed with project_free_matches.
+ *
+ * Return Value: The number of lines that matched, or -1 if the pattern is
+ *               not valid.
+ */
+int project_search(const char *regex, int icase,
+        struct project_match **matches);
+
+/* project_free_matches:  Frees the lines from project_search.
+ * ---------------------
+ *
+ *   matches:  The lines
+ *   count:    The number of lines
+ */
+void project_free_matches(struct project_match *matches, int count);
+
+#endif /* _PROJECT_H_ */
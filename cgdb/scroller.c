@@ -27,53 +27,126 @@
 /* Local Includes */
 #include "cgdb.h"
 #include "scroller.h"
+#include "highlight.h"
+#include "highlight_groups.h"
+#include "cgdbrc.h"
+
+/* The number of lines a scroller keeps until it is told otherwise */
+#define SCR_DEFAULT_SCROLLBACK 10000
 
 /* --------------- */
 /* Local Functions */
 /* --------------- */
 
-/* count: Count the occurrences of a character c in a string s.
- * ------
+/* line: Gets a line of the buffer.
+ * -----
  *
- *   s:  String to search
- *   c:  Character to search for
+ *   scr:  Pointer to the scroller object
+ *   r:    The line number, 0 being the oldest line kept
  *
- * Return Value:  Number of occurrences of c in s.
+ * Return Value:  Where the line is kept in the ring.
  */
-static int count(const char *s, char c)
+static struct scroller_line *line(struct scroller *scr, int r)
 {
-    int rv = 0;
-    char *x = strchr(s, c);
+    return &scr->lines[(scr->first + r) % scr->capacity];
+}
 
-    while (x) {
-        rv++;
-        x = strchr(x + 1, c);
+/* drop_lines: Moves the lines kept track of up, after the oldest lines of
+ * -----------  the buffer are dropped.  A line that was dropped becomes the
+ *              oldest line left.
+ *
+ *   scr:  Pointer to the scroller object
+ *   n:    The number of lines dropped
+ */
+static void drop_lines(struct scroller *scr, int n)
+{
+    if (scr->current.r >= n)
+        scr->current.r -= n;
+    else {
+        scr->current.r = 0;
+        scr->current.c = 0;
     }
 
-    return rv;
+    if (scr->search.r >= n)
+        scr->search.r -= n;
+    else {
+        scr->search.r = 0;
+        scr->search.c = 0;
+    }
+
+    if (scr->search.rline >= n)
+        scr->search.rline -= n;
+    else {
+        scr->search.rline = 0;
+        scr->search.col_rbeg = 0;
+        scr->search.col_rend = 0;
+    }
+
+    if (scr->search.line >= n)
+        scr->search.line -= n;
+    else {
+        scr->search.line = 0;
+        scr->search.match_beg = -1;
+        scr->search.match_end = -1;
+    }
+}
+
+/* add_line: Appends a line to the buffer, dropping the oldest line if the
+ * ---------  buffer is full.
+ *
+ *   scr:   Pointer to the scroller object
+ *   text:  The line, which the scroller now owns
+ */
+static void add_line(struct scroller *scr, char *text)
+{
+    struct scroller_line *l;
+
+    if (scr->length < scr->capacity) {
+        scr->length++;
+        l = line(scr, scr->length - 1);
+        l->text = text;
+        l->length = strlen(text);
+        return;
+    }
+
+    l = &scr->lines[scr->first];
+    free(l->text);
+    l->text = text;
+    l->length = strlen(text);
+    scr->first = (scr->first + 1) % scr->capacity;
+
+    /* Stay on the same line, unless it was the one dropped */
+    drop_lines(scr, 1);
 }
 
-/* parse: Translates special characters in a string.  (i.e. backspace, tab...)
- * ------
+/* parse: Adds text to the last line, translating special characters in it
+ * ------  (i.e. backspace, tab...)
  *
- *   buf:  The string to parse
+ * The last line is edited in place, and has room to grow, so this takes
+ * time in proportion to the text added and not to the length of the line.
  *
- * Return Value:  A newly allocated copy of buf, with modifications made.
+ *   scr:     Pointer to the scroller object
+ *   buf:     The text to add
+ *   length:  The number of characters of buf to add
  */
-static char *parse(struct scroller *scr, const char *orig, const char *buf)
+static void parse(struct scroller *scr, const char *buf, int length)
 {
     const int tab_size = 8;
-    int length = strlen(orig) + strlen(buf) + (tab_size - 1) * count(buf, '\t');
-    char *rv = (char *) malloc(length + 1);
-    int i, j;
-
-    /* Zero out the string */
-    memset(rv, 0, length + 1);
-    strcpy(rv, orig);
-    i = scr->current.pos;
+    struct scroller_line *l = line(scr, scr->length - 1);
+    char *rv = l->text;
+    int end = l->length;
+    int i = scr->current.pos;
+    int j;
 
     /* Expand special characters */
-    for (j = 0; j < strlen(buf); j++) {
+    for (j = 0; j < length; j++) {
+        /* Make room for a tab, the most a character can add */
+        if (i + tab_size >= scr->last_size) {
+            scr->last_size = (i + tab_size + 1) * 2;
+            rv = realloc(rv, scr->last_size);
+            l->text = rv;
+        }
+
         switch (buf[j]) {
                 /* Backspace/Delete -> Erase last character */
             case 8:
@@ -99,14 +172,53 @@ static char *parse(struct scroller *scr, const char *orig, const char *buf)
                 }
                 break;
         }
+
+        if (i > end)
+            end = i;
     }
 
     scr->current.pos = i;
     /* Remove trailing space from the line */
-    for (j = strlen(rv) - 1; j > i && isspace((int) rv[j]); j--);
+    for (j = end - 1; j > i && isspace((int) rv[j]); j--);
     rv[j + 1] = 0;
+    l->length = j + 1;
+}
 
-    return realloc(rv, strlen(rv) + 1);
+/* get_line: Gets a line of the buffer for hl_regex to search. */
+static const char *get_line(void *data, int r)
+{
+    return line((struct scroller *) data, r)->text;
+}
+
+/* draw_match: Highlights the part of a match that is on a row.
+ * -----------
+ *
+ *   scr:    Pointer to the scroller object
+ *   y:      The row on the screen
+ *   c:      The column of the line the row starts at
+ *   width:  The width of the row
+ *   text:   The line
+ *   beg:    Where the match starts
+ *   end:    Where the match ends
+ *   group:  How to highlight it
+ */
+static void draw_match(struct scroller *scr, int y, int c, int width,
+        const char *text, int beg, int end, enum hl_group_kind group)
+{
+    int attr;
+
+    if (beg < c)
+        beg = c;
+    if (end > c + width)
+        end = c + width;
+    if (beg >= end ||
+            hl_groups_get_attr(hl_groups_instance, group, &attr) == -1)
+        return;
+
+    wmove(scr->win, y, beg - c);
+    wattron(scr->win, attr);
+    waddnstr(scr->win, text + beg, end - beg);
+    wattroff(scr->win, attr);
 }
 
 /* ----------------- */
@@ -128,23 +240,68 @@ struct scroller *scr_new(int pos_r, int pos_c, int height, int width)
     rv->win = newwin(height, width, pos_r, pos_c);
 
     /* Start with a single (blank) line */
-    rv->buffer = malloc(sizeof (char *));
-    rv->buffer[0] = strdup("");
+    rv->capacity = SCR_DEFAULT_SCROLLBACK;
+    rv->lines = malloc(sizeof (struct scroller_line) * rv->capacity);
+    rv->lines[0].text = strdup("");
+    rv->lines[0].length = 0;
+    rv->first = 0;
     rv->length = 1;
+    rv->last_size = 1;
+    rv->row = NULL;
+    rv->row_size = 0;
+
+    rv->search.line = 0;
+    rv->search.match_beg = -1;
+    rv->search.match_end = -1;
+    rv->search.rline = 0;
+    rv->search.col_rbeg = 0;
+    rv->search.col_rend = 0;
+    rv->search.r = 0;
+    rv->search.c = 0;
+    rv->search.regex = NULL;
+    rv->search.icase = 0;
 
     return rv;
 }
 
+void scr_set_scrollback(struct scroller *scr, int lines)
+{
+    struct scroller_line *kept;
+    int drop, i;
+
+    if (lines < 1 || lines == scr->capacity)
+        return;
+
+    /* Keep the newest lines */
+    drop = scr->length > lines ? scr->length - lines : 0;
+    for (i = 0; i < drop; i++)
+        free(line(scr, i)->text);
+
+    kept = malloc(sizeof (struct scroller_line) * lines);
+    for (i = drop; i < scr->length; i++)
+        kept[i - drop] = *line(scr, i);
+
+    free(scr->lines);
+    scr->lines = kept;
+    scr->capacity = lines;
+    scr->first = 0;
+    scr->length -= drop;
+
+    drop_lines(scr, drop);
+    hl_regex_forget(scr);
+}
+
 void scr_free(struct scroller *scr)
 {
     int i;
 
     /* Release the buffer */
-    if (scr->length) {
-        for (i = 0; i < scr->length; i++)
-            free(scr->buffer[i]);
-        free(scr->buffer);
-    }
+    for (i = 0; i < scr->length; i++)
+        free(line(scr, i)->text);
+    free(scr->lines);
+    free(scr->row);
+    free(scr->search.regex);
+    hl_regex_forget(scr);
     delwin(scr->win);
 
     /* Release the scroller object */
@@ -173,7 +330,7 @@ void scr_up(struct scroller *scr, int nlines)
         else {
             if (scr->current.r > 0) {
                 scr->current.r--;
-                if ((length = strlen(scr->buffer[scr->current.r])) > width)
+                if ((length = line(scr, scr->current.r)->length) > width)
                     scr->current.c = ((length - 1) / width) * width;
             } else {
                 /* At top */
@@ -198,7 +355,7 @@ void scr_down(struct scroller *scr, int nlines)
 
     for (i = 0; i < nlines; i++) {
         /* If the current line wraps to the next, then advance column number */
-        length = strlen(scr->buffer[scr->current.r]);
+        length = line(scr, scr->current.r)->length;
         if (scr->current.c < length - width)
             scr->current.c += width;
 
@@ -228,55 +385,120 @@ void scr_end(struct scroller *scr)
     getmaxyx(scr->win, height, width);
 
     scr->current.r = scr->length - 1;
-    scr->current.c = (strlen(scr->buffer[scr->current.r]) / width) * width;
+    scr->current.c = (line(scr, scr->current.r)->length / width) * width;
+}
+
+int scr_at_end(struct scroller *scr)
+{
+    int width = getmaxx(scr->win);
+
+    return scr->current.r == scr->length - 1 &&
+            scr->current.c + width >= line(scr, scr->current.r)->length;
+}
+
+void scr_search_regex_init(struct scroller *scr)
+{
+    hl_regex_forget(scr);
+
+    /* Start from beginning of line if not at same line */
+    if (scr->search.rline != scr->current.r) {
+        scr->search.col_rbeg = 0;
+        scr->search.col_rend = 0;
+    }
+
+    /* Start searching at the bottom line shown */
+    scr->search.rline = scr->current.r;
+    scr->search.line = scr->current.r;
+    scr->search.match_beg = -1;
+    scr->search.match_end = -1;
+    scr->search.r = scr->current.r;
+    scr->search.c = scr->current.c;
+}
+
+int scr_search_regex(struct scroller *scr, const char *regex, int opt,
+        int direction, int icase)
+{
+    int width;
+    int result;
+
+    result = hl_regex(regex, get_line, scr, NULL, scr->length,
+            &scr->search.match_beg, &scr->search.match_end,
+            &scr->search.line, &scr->search.rline, &scr->search.col_rbeg,
+            &scr->search.col_rend, opt, direction, icase);
+
+    if (result != 1) {
+        scr_search_regex_cancel(scr);
+        return result;
+    }
+
+    /* Keep a permanent match highlighted, with the others like it */
+    if (opt == 2) {
+        scr->search.match_beg = scr->search.col_rbeg;
+        scr->search.match_end = scr->search.col_rend;
+        free(scr->search.regex);
+        scr->search.regex = strdup(regex);
+        scr->search.icase = icase;
+    }
+
+    width = getmaxx(scr->win);
+    scr->current.r = scr->search.line;
+    scr->current.c = (scr->search.match_beg / width) * width;
+
+    return result;
+}
+
+void scr_search_regex_cancel(struct scroller *scr)
+{
+    scr->search.match_beg = -1;
+    scr->search.match_end = -1;
+    scr->current.r = scr->search.r;
+    scr->current.c = scr->search.c;
+}
+
+void scr_nohlsearch(struct scroller *scr)
+{
+    free(scr->search.regex);
+    scr->search.regex = NULL;
+    scr->search.match_beg = -1;
+    scr->search.match_end = -1;
 }
 
 void scr_add(struct scroller *scr, const char *buf)
 {
     int distance;               /* Distance to next new line character */
-    int length;                 /* Length of the current line */
     char *x;                    /* Pointer to next new line character */
 
     /* Find next newline in the string */
     x = strchr(buf, '\n');
-    length = strlen(scr->buffer[scr->length - 1]);
     distance = x ? x - buf : strlen(buf);
 
     /* Append to the last line in the buffer */
-    if (distance > 0) {
-        char *temp = scr->buffer[scr->length - 1];
-        char *buf2 = malloc(distance + 1);
-
-        strncpy(buf2, buf, distance);
-        buf2[distance] = 0;
-        scr->buffer[scr->length - 1] = parse(scr, temp, buf2);
-        free(temp);
-        free(buf2);
-    }
+    if (distance > 0)
+        parse(scr, buf, distance);
 
     /* Create additional lines if buf contains newlines */
     while (x != NULL) {
-        char *newbuf;
+        struct scroller_line *last = line(scr, scr->length - 1);
+
+        /* The last line is done growing */
+        last->text = realloc(last->text, last->length + 1);
 
         buf = x + 1;
         x = strchr(buf, '\n');
         distance = x ? x - buf : strlen(buf);
 
-        /* Create a new buffer that stops at the next newline */
-        newbuf = malloc(distance + 1);
-        memset(newbuf, 0, distance + 1);
-        strncpy(newbuf, buf, distance);
-
-        /* Expand the buffer */
-        scr->length++;
-        scr->buffer = realloc(scr->buffer, sizeof (char *) * scr->length);
-        scr->current.pos = 0;
-
         /* Add the new line */
-        scr->buffer[scr->length - 1] = parse(scr, "", newbuf);
-        free(newbuf);
+        add_line(scr, strdup(""));
+        scr->last_size = 1;
+        scr->current.pos = 0;
+        parse(scr, buf, distance);
     }
 
+    /* A match is only shown until there is more output */
+    hl_regex_forget(scr);
+    scr->search.match_beg = -1;
+    scr->search.match_end = -1;
+
     scr_end(scr);
 }
 
@@ -287,37 +509,76 @@ void scr_move(struct scroller *scr, int pos_r, int pos_c, int height, int width)
     wclear(scr->win);
 }
 
-void scr_refresh(struct scroller *scr, int focus)
+void scr_refresh(struct scroller *scr, int focus, int dorefresh)
 {
     int length;                 /* Length of current line */
     int nlines;                 /* Number of lines written so far */
     int r;                      /* Current row in scroller */
     int c;                      /* Current column in row */
     int width, height;          /* Width and height of window */
-    char *buffer;               /* Current line segment to print */
+    char *row;                  /* Current line segment to print */
+    struct scroller_line *l;
+    struct hl_match *matches = NULL;    /* The matches on line matches_r */
+    struct hl_match *m;
+    int matches_r = -1;
+    int hlsearch = scr->search.regex &&
+            cgdbrc_get(CGDBRC_HLSEARCH)->variant.int_val;
 
     /* Sanity check */
     getmaxyx(scr->win, height, width);
 
+    /* The row is kept from one refresh to the next */
+    if (scr->row_size < width) {
+        scr->row = realloc(scr->row, width);
+        scr->row_size = width;
+    }
+    row = scr->row;
+
     if (scr->current.c > 0) {
         if (scr->current.c % width != 0)
             scr->current.c = (scr->current.c / width) * width;
     }
     r = scr->current.r;
     c = scr->current.c;
-    buffer = malloc(width + 1);
-    buffer[width] = 0;
 
-    /* Start drawing at the bottom of the viewable space, and work our way up */
+    /* Start drawing at the bottom of the viewable space, and work our way up.
+     * Only the rows on the screen are looked at, since the length of each
+     * line is known. */
     for (nlines = 1; nlines <= height; nlines++) {
 
         /* Print the current line [segment] */
-        memset(buffer, ' ', width);
+        length = 0;
         if (r >= 0) {
-            length = strlen(scr->buffer[r] + c);
-            memcpy(buffer, scr->buffer[r] + c, length < width ? length : width);
+            l = line(scr, r);
+            length = l->length - c;
+            if (length > width)
+                length = width;
+            else if (length < 0)
+                length = 0;
+            memcpy(row, l->text + c, length);
+        }
+        memset(row + length, ' ', width - length);
+        wmove(scr->win, height - nlines, 0);
+        waddnstr(scr->win, row, width);
+
+        /* Draw the matches of the last search over the row */
+        if (r >= 0 && hlsearch) {
+            if (r != matches_r) {
+                free(matches);
+                matches = hl_regex_matches(scr->search.regex,
+                        scr->search.icase, l->text);
+                matches_r = r;
+            }
+
+            for (m = matches; m->end > m->beg; m++)
+                draw_match(scr, height - nlines, c, width, l->text,
+                        m->beg, m->end, HLG_HLSEARCH);
         }
-        mvwprintw(scr->win, height - nlines, 0, "%s", buffer);
+
+        if (r >= 0 && r == scr->search.line && scr->search.match_beg != -1)
+            draw_match(scr, height - nlines, c, width, l->text,
+                    scr->search.match_beg, scr->search.match_end,
+                    HLG_SEARCH);
 
         /* Update our position */
         if (c >= width)
@@ -325,14 +586,16 @@ void scr_refresh(struct scroller *scr, int focus)
         else {
             r--;
             if (r >= 0) {
-                length = strlen(scr->buffer[r]);
+                length = line(scr, r)->length;
                 if (length > width)
                     c = ((length - 1) / width) * width;
             }
         }
     }
 
-    length = strlen(scr->buffer[scr->current.r] + scr->current.c);
+    free(matches);
+
+    length = line(scr, scr->current.r)->length - scr->current.c;
     if (focus && scr->current.r == scr->length - 1 && length <= width) {
         /* We're on the last line, draw the cursor */
         curs_set(1);
@@ -342,6 +605,8 @@ void scr_refresh(struct scroller *scr, int focus)
         curs_set(0);
     }
 
-    free(buffer);
-    wrefresh(scr->win);
+    if (dorefresh)
+        wrefresh(scr->win);
+    else
+        wnoutrefresh(scr->win);
 }
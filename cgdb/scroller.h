@@ -24,14 +24,39 @@
 /* Data Structures */
 /* --------------- */
 
+/* A line of output */
+struct scroller_line {
+    char *text;                 /* The text of the line */
+    int length;                 /* The length of text */
+};
+
+/* The lines are kept in a ring.  When it is full, the oldest line is
+ * dropped to make room for the next one. */
 struct scroller {
-    char **buffer;              /* The text buffer */
+    struct scroller_line *lines;    /* The lines, 'capacity' long */
+    int capacity;               /* Most lines kept */
+    int first;                  /* Index in lines of the oldest line */
     int length;                 /* Number of lines in buffer */
+    int last_size;              /* Bytes allocated for the last line */
+    char *row;                  /* Where a row is put together to draw it */
+    int row_size;               /* Bytes allocated for row */
     struct {
         int r;                  /* Current line (row) number */
         int c;                  /* Current column number */
         int pos;                /* Cursor position in last line */
     } current;
+    struct {
+        int line;               /* The line the match below is on */
+        int match_beg;          /* Where the match shown starts, or -1 */
+        int match_end;          /* Where the match shown ends, or -1 */
+        int rline;              /* The line the next search starts from */
+        int col_rbeg;           /* Where the last match on rline starts */
+        int col_rend;           /* Where the last match on rline ends */
+        int r;                  /* The current line and column when the */
+        int c;                  /*   search started, to go back to */
+        char *regex;            /* The last search, or NULL */
+        int icase;              /* If regex ignores case */
+    } search;
     WINDOW *win;                /* The scoller's own window */
 };
 
@@ -51,6 +76,16 @@ struct scroller {
  */
 struct scroller *scr_new(int pos_r, int pos_c, int height, int width);
 
+/* scr_set_scrollback: Sets the number of lines a scroller keeps
+ * -------------------
+ *
+ * If there are more lines than that, the oldest ones are dropped.
+ *
+ *   scr:    Pointer to the scroller object
+ *   lines:  Number of lines to keep, at least 1
+ */
+void scr_set_scrollback(struct scroller *scr, int lines);
+
 /* scr_free: Releases the memory allocated by a scroller
  * ---------
  *
@@ -88,6 +123,61 @@ void scr_home(struct scroller *scr);
  */
 void scr_end(struct scroller *scr);
 
+/* scr_at_end: Checks if the last line of the buffer is shown at the bottom
+ * -----------
+ *
+ *   scr:  Pointer to the scroller object
+ *
+ * Return Value: Nonzero if it is, 0 if the scroller is scrolled back.
+ */
+int scr_at_end(struct scroller *scr);
+
+/* scr_search_regex_init: Should be called before scr_search_regex
+ * ----------------------
+ *
+ * The search starts from the bottom line shown, or after the last match if
+ * it is still that line.  The scroller goes back to where it is now if
+ * the search is cancelled.
+ *
+ *   scr:  Pointer to the scroller object
+ */
+void scr_search_regex_init(struct scroller *scr);
+
+/* scr_search_regex: Searches the buffer for a regular expression, and
+ * -----------------  shows the line it matches on at the bottom.
+ *
+ * Each line is looked at once at most, going from the newest line back to
+ * the oldest in a reverse search.  While the user types the pattern, the
+ * lines before the last match are not looked at again.
+ *
+ *   scr:        Pointer to the scroller object
+ *   regex:      The regular expression to search for
+ *   opt:        If 1, the search is temporary ( User has not hit enter )
+ *               If 2, the search is permanent, and its matches are
+ *               highlighted until the next one
+ *   direction:  1 if forward, 0 if reverse
+ *   icase:      1 if case insensitive, 0 otherwise
+ *
+ * Return Value: 1 if the pattern matched, 0 if not, and negative if it is
+ *               empty or not valid.
+ */
+int scr_search_regex(struct scroller *scr, const char *regex, int opt,
+        int direction, int icase);
+
+/* scr_search_regex_cancel: Goes back to where the scroller was when
+ * ------------------------ scr_search_regex_init was called.
+ *
+ *   scr:  Pointer to the scroller object
+ */
+void scr_search_regex_cancel(struct scroller *scr);
+
+/* scr_nohlsearch: Stops highlighting the matches of the last search
+ * ---------------
+ *
+ *   scr:  Pointer to the scroller object
+ */
+void scr_nohlsearch(struct scroller *scr);
+
 /* scr_add:  Append a string to the buffer.
  * --------
  *
@@ -112,9 +202,11 @@ void scr_move(struct scroller *scr,
  * ------------ damages the screen area where the scroller is written (or,
  *              perhaps the terminal size has changed, and you wish to redraw).
  *
- *   scr:    Pointer to the scroller object
- *   focus:  If the window has focus
+ *   scr:        Pointer to the scroller object
+ *   focus:      If the window has focus
+ *   dorefresh:  If zero, the window is only copied to the virtual screen
+ *               (wnoutrefresh), and the caller must call doupdate().
  */
-void scr_refresh(struct scroller *scr, int focus);
+void scr_refresh(struct scroller *scr, int focus, int dorefresh);
 
 #endif
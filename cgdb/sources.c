@@ -3,11 +3,17 @@
  * 
  * Source file management routines for the GUI.  Provides the ability to
  * add files to the list, load files, and display within a curses window.
- * Files are buffered in memory when they are displayed, and held in
- * memory for the duration of execution.  If memory consumption becomes a
- * problem, this can be optimized to unload files which have not been
- * displayed recently, or only load portions of large files at once. (May
- * affect syntax hilighting.)
+ * Files are read into memory when they are displayed.  The loaded files
+ * are kept on a least recently used list, and when they take up more memory
+ * than the maxmemtot option allows, the files which have not been displayed
+ * recently are unloaded.  An unloaded file keeps its path, breakpoints and
+ * selection, and is loaded again the next time it is displayed.
+ * Files bigger than the largefile option are not split into lines up front;
+ * only a window of lines around the selected line is kept in memory.
+ * Loaded files are watched with inotify, so they are only read again when
+ * they change.  When a loaded file changes, the new version is compared with
+ * the old one line by line, so that highlighting, breakpoints and the
+ * selection follow the lines that did not change.
  *
  */
 
@@ -44,6 +50,22 @@
 #include <unistd.h>
 #endif /* HAVE_UNISTD_H */
 
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif /* HAVE_FCNTL_H */
+
+#if HAVE_SYS_VFS_H
+#include <sys/vfs.h>
+#endif /* HAVE_SYS_VFS_H */
+
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif /* HAVE_SYS_INOTIFY_H */
+
+#if HAVE_TIME_H
+#include <time.h>
+#endif /* HAVE_TIME_H */
+
 #if HAVE_CTYPE_H
 #include <ctype.h>
 #endif
@@ -56,6 +78,14 @@
 #include "sys_util.h"
 #include "cgdbrc.h"
 #include "highlight_groups.h"
+#include "std_hash.h"
+
+/* When a file is reloaded, and the new version differs from the old in more
+ * lines than this, they are not compared line by line. */
+#define DIFF_MAX_EDITS 1000
+
+/* How much of a large file is read at a time to index it */
+#define SOURCE_LARGE_CHUNK (1024 * 1024)
 
 int sources_syntax_on = 1;
 
@@ -89,15 +119,10 @@ static int verify_file_exists(const char *path)
 static struct list_node *get_relative_node(struct sviewer *sview,
         const char *lpath)
 {
+    if (!lpath)
+        return NULL;
 
-    struct list_node *cur;
-
-    for (cur = sview->list_head; cur != NULL; cur = cur->next)
-        if (cur->lpath)
-            if (strcmp(lpath, cur->lpath) == 0)
-                return cur;
-
-    return NULL;
+    return std_hash_table_lookup(sview->lpath_index, lpath);
 }
 
 /* get_node:  Returns a pointer to the node that matches the given path.
@@ -105,185 +130,1422 @@ static struct list_node *get_relative_node(struct sviewer *sview,
  
  *   path:  Full path to source file
  *
- * Return Value:  Pointer to the matching node, or NULL if not found.
+ * Return Value:  Pointer to the matching node, or NULL if not found.
+ */
+static struct list_node *get_node(struct sviewer *sview, const char *path)
+{
+    if (!path)
+        return NULL;
+
+    return std_hash_table_lookup(sview->path_index, path);
+}
+
+/**
+ * Get's the timestamp of a particular file.
+ *
+ * \param path
+ * The path to the file to get the timestamp of
+ *
+ * \param timestamp
+ * The timestamp of the file, or 0 on error.
+ * 
+ * \return
+ * 0 on success, -1 on error.
+ */
+static int get_timestamp(const char *path, time_t * timestamp)
+{
+    struct stat s;
+    int val;
+
+    if (!path)
+        return -1;
+
+    if (!timestamp)
+        return -1;
+
+    *timestamp = 0;
+
+    val = stat(path, &s);
+
+    if (val)                    /* Error on timestamp */
+        return -1;
+
+    *timestamp = s.st_mtime;
+
+    return 0;
+}
+
+static void init_file_buffer(struct buffer *buf)
+{
+    buf->length = 0;
+    buf->tlines = NULL;         /* This signals an empty buffer */
+    buf->match_beg = -1;
+    buf->match_end = -1;
+    buf->max_width = 0;
+    buf->hashes = NULL;
+    buf->text = NULL;
+    buf->text_size = 0;
+    buf->large = 0;
+    buf->fd = -1;
+    buf->blocks = NULL;
+    buf->window = NULL;
+    buf->wlines = NULL;
+    buf->wstart = 0;
+    buf->wlength = 0;
+    buf->wspans = NULL;
+    buf->wlanguage = TOKENIZER_LANGUAGE_UNKNOWN;
+    buf->wspans_size = 0;
+}
+
+static int release_file_buffer(struct buffer *buf)
+{
+    int i;
+
+    /* Nothing to free */
+    if (!buf)
+        return 0;
+
+    /* Lines only need to be freed when they are not part of a text block */
+    if (!buf->text && buf->tlines) {
+        for (i = 0; i < buf->length; ++i) {
+            free(buf->tlines[i]);
+            buf->tlines[i] = NULL;
+        }
+    }
+
+    free(buf->tlines);
+    buf->tlines = NULL;
+    buf->length = 0;
+    buf->match_beg = -1;
+    buf->match_end = -1;
+    buf->max_width = 0;
+    free(buf->hashes);
+    buf->hashes = NULL;
+
+    highlight_block_free(buf->wspans, buf->wlength);
+    buf->wspans = NULL;
+    buf->wspans_size = 0;
+    free(buf->wlines);
+    buf->wlines = NULL;
+    free(buf->window);
+    buf->window = NULL;
+    buf->wstart = 0;
+    buf->wlength = 0;
+    free(buf->blocks);
+    buf->blocks = NULL;
+    buf->large = 0;
+
+    if (buf->fd != -1)
+        close(buf->fd);
+    buf->fd = -1;
+
+    free(buf->text);
+    buf->text = NULL;
+    buf->text_size = 0;
+
+    return 0;
+}
+
+/** 
+ * Remove's the memory related to a file.
+ *
+ * \param node
+ * The node who's file buffer data needs to be freed.
+ *
+ * \return
+ * 0 on success, or -1 on error.
+ */
+static int release_file_memory(struct list_node *node)
+{
+    if (!node)
+        return -1;
+
+    /* The highlighting refers to the lines of the buffer */
+    highlight_release(node);
+
+    /* Free the buffer */
+    if (release_file_buffer(&node->buf) == -1)
+        return -1;
+
+    return 0;
+}
+
+/* read_text: Reads an entire file into a newly allocated, NUL terminated
+ * ----------  block.
+ *
+ * The file is read, and not mapped, so that the text stays good when the
+ * file is truncated or rewritten while it is loaded.
+ *
+ *   fd:    An open descriptor for the file
+ *   size:  The size of the file
+ *   nread: Returns the number of bytes actually read
+ *
+ * Return Value:  The block of text, or NULL on error.
+ */
+static char *read_text(int fd, size_t size, size_t *nread)
+{
+    char *text = cgdb_malloc(size + 1);
+    size_t pos = 0;
+    ssize_t n;
+
+    while (pos < size) {
+        n = read(fd, text + pos, size - pos);
+        if (n == -1) {
+            free(text);
+            return NULL;
+        }
+
+        /* The file shrank while reading it */
+        if (n == 0)
+            break;
+
+        pos += n;
+    }
+
+    text[pos] = 0;
+    *nread = pos;
+
+    return text;
+}
+
+/* read_at: Reads part of a file into a block.
+ * --------
+ *
+ *   fd:      An open descriptor for the file
+ *   block:   Where to put the text
+ *   size:    The number of bytes to read
+ *   offset:  Where in the file to start
+ *
+ * Return Value:  The number of bytes read, which is less than size if the
+ *                file is shorter than it was.
+ */
+static size_t read_at(int fd, char *block, size_t size, off_t offset)
+{
+    size_t pos = 0;
+    ssize_t n;
+
+    while (pos < size) {
+        n = pread(fd, block + pos, size - pos, offset + pos);
+        if (n <= 0)
+            break;
+
+        pos += n;
+    }
+
+    return pos;
+}
+
+/* index_text: Builds the line index of a buffer from its text block.
+ * -----------
+ *
+ * A single pass is made over the text. Each line terminator is replaced by
+ * a NUL, so every entry in tlines is a string pointing directly into the
+ * text block.
+ *
+ *   buf:  The buffer whose text block should be indexed
+ */
+static void index_text(struct buffer *buf)
+{
+    char *pos = buf->text;
+    char *end = buf->text + buf->text_size;
+    int capacity = 0;
+
+    buf->length = 0;
+    buf->tlines = NULL;
+    buf->max_width = 0;
+
+    while (pos < end) {
+        char *eol = memchr(pos, '\n', end - pos);
+        char *next;
+
+        if (eol) {
+            next = eol + 1;
+        } else {
+            /* The last line does not end in a newline. read_text puts a
+             * zero after the end of the file. */
+            eol = end;
+            next = end;
+        }
+
+        if (eol > pos && eol[-1] == '\r')
+            eol--;
+
+        if (*eol)
+            *eol = 0;
+
+        if (buf->length == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            buf->tlines = cgdb_realloc(buf->tlines, sizeof (char *) * capacity);
+        }
+        buf->tlines[buf->length++] = pos;
+
+        if (eol - pos > buf->max_width)
+            buf->max_width = eol - pos;
+
+        pos = next;
+    }
+
+    /* Give back the unused part of the index */
+    if (buf->length > 0 && buf->length < capacity)
+        buf->tlines = cgdb_realloc(buf->tlines, sizeof (char *) * buf->length);
+}
+
+/* index_large: Builds the line index of a large file.
+ * ------------
+ *
+ * A single pass is made over the file, SOURCE_LARGE_CHUNK bytes at a time,
+ * so the text is never all in memory.  Only the offset of every
+ * SOURCE_LARGE_BLOCK-th line is kept, so the index stays small however
+ * many lines the file has.
+ *
+ *   buf:  The buffer whose file should be indexed
+ *   fd:   An open descriptor for the file, at its start
+ *
+ * Return Value:  Zero on success, non-zero on error.
+ */
+static int index_large(struct buffer *buf, int fd)
+{
+    char *chunk = cgdb_malloc(SOURCE_LARGE_CHUNK);
+    size_t offset = 0;          /* The offset of chunk in the file */
+    int count = 0, capacity = 0;
+    int at_start = 1;           /* The next byte starts a line */
+    int width = 0;              /* The width of the line so far */
+    int cr = 0;                 /* Nonzero if it ends in a '\r' so far */
+    ssize_t n;
+
+    buf->length = 0;
+    buf->max_width = 0;
+
+    while ((n = read(fd, chunk, SOURCE_LARGE_CHUNK)) > 0) {
+        const char *pos = chunk;
+        const char *end = chunk + n;
+
+        while (pos < end) {
+            const char *eol;
+
+            if (at_start) {
+                if (buf->length % SOURCE_LARGE_BLOCK == 0) {
+                    if (count + 1 >= capacity) {
+                        capacity = capacity ? capacity * 2 : 64;
+                        buf->blocks = cgdb_realloc(buf->blocks,
+                                sizeof (size_t) * capacity);
+                    }
+                    buf->blocks[count++] = offset + (pos - chunk);
+                }
+
+                buf->length++;
+                at_start = 0;
+                width = 0;
+                cr = 0;
+            }
+
+            eol = memchr(pos, '\n', end - pos);
+            if (!eol) {
+                width += end - pos;
+                cr = end[-1] == '\r';
+                break;
+            }
+
+            width += eol - pos;
+            if (eol > pos)
+                cr = eol[-1] == '\r';
+
+            if (width - cr > buf->max_width)
+                buf->max_width = width - cr;
+
+            at_start = 1;
+            pos = eol + 1;
+        }
+
+        offset += n;
+    }
+
+    free(chunk);
+
+    if (n == -1)
+        return -1;
+
+    /* The last line does not end in a newline */
+    if (!at_start && width - cr > buf->max_width)
+        buf->max_width = width - cr;
+
+    /* The end of the last block */
+    buf->blocks = cgdb_realloc(buf->blocks, sizeof (size_t) * (count + 1));
+    buf->blocks[count] = offset;
+    buf->text_size = offset;
+
+    return 0;
+}
+
+/* read_file:  Reads a file into a buffer, and splits it into lines.
+ * ----------
+ *
+ * A file at least as big as the largefile option is only indexed, see
+ * index_large, and kept open to read the lines in its window.
+ *
+ *   path:  The file to read
+ *   buf:   The buffer to fill in.  It gets no breakpoints.
+ *
+ * Return Value:  Zero on success, non-zero on error.
+ */
+static int read_file(const char *path, struct buffer *buf)
+{
+    off_t large =
+            (off_t) cgdbrc_get(CGDBRC_LARGEFILE)->variant.int_val * 1024;
+    struct stat st;
+    int fd, i;
+
+    init_file_buffer(buf);
+
+    if ((fd = open(path, O_RDONLY)) == -1)
+        return 1;
+
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return 1;
+    }
+
+    buf->large = large != 0 && st.st_size >= large;
+
+    if (buf->large) {
+        if (index_large(buf, fd)) {
+            close(fd);
+            return 1;
+        }
+
+        buf->fd = fd;
+        return 0;
+    }
+
+    buf->text = read_text(fd, st.st_size, &buf->text_size);
+    close(fd);
+    if (!buf->text)
+        return 1;
+
+    index_text(buf);
+
+    buf->hashes = cgdb_malloc(sizeof (unsigned int) * (buf->length + 1));
+    for (i = 0; i < buf->length; i++)
+        buf->hashes[i] = std_str_hash(buf->tlines[i]);
+
+    return 0;
+}
+
+/* window_load: Copies the lines around a line of a large file into its
+ * ------------  window.  The lines that were in the window are dropped.
+ *
+ *   buf:   The buffer of the large file
+ *   line:  The line that should be in the window
+ */
+static void window_load(struct buffer *buf, int line)
+{
+    int blocks = (buf->length + SOURCE_LARGE_BLOCK - 1) / SOURCE_LARGE_BLOCK;
+    int first = line / SOURCE_LARGE_BLOCK - SOURCE_LARGE_WINDOW / 2;
+    int last, i;
+    size_t start, size;
+    char *pos, *end;
+
+    if (first > blocks - SOURCE_LARGE_WINDOW)
+        first = blocks - SOURCE_LARGE_WINDOW;
+    if (first < 0)
+        first = 0;
+    last = first + SOURCE_LARGE_WINDOW;
+    if (last > blocks)
+        last = blocks;
+
+    highlight_block_free(buf->wspans, buf->wlength);
+    buf->wspans = NULL;
+    buf->wspans_size = 0;
+
+    start = buf->blocks[first];
+    size = buf->blocks[last] - start;
+    buf->window = cgdb_realloc(buf->window, size + 1);
+
+    /* The lines past the end of a file that shrank are left empty */
+    size = read_at(buf->fd, buf->window, size, start);
+    buf->window[size] = 0;
+
+    buf->wstart = first * SOURCE_LARGE_BLOCK;
+    buf->wlength = last * SOURCE_LARGE_BLOCK;
+    if (buf->wlength > buf->length)
+        buf->wlength = buf->length;
+    buf->wlength -= buf->wstart;
+    buf->wlines = cgdb_realloc(buf->wlines, sizeof (char *) * buf->wlength);
+
+    /* Split the lines the same way index_text does */
+    pos = buf->window;
+    end = buf->window + size;
+    for (i = 0; i < buf->wlength; i++) {
+        char *eol = memchr(pos, '\n', end - pos);
+        char *next = eol ? eol + 1 : end;
+
+        if (!eol)
+            eol = end;
+
+        if (eol > pos && eol[-1] == '\r')
+            eol--;
+
+        *eol = 0;
+        buf->wlines[i] = pos;
+        pos = next;
+    }
+}
+
+/* buffer_line: Gets a line of a buffer.
+ * ------------
+ *
+ * The line of a large file is only good until a line that is not in its
+ * window is asked for.
+ *
+ *   buf:   The buffer
+ *   line:  The line number, which must be in the buffer
+ */
+static char *buffer_line(struct buffer *buf, int line)
+{
+    if (!buf->large)
+        return buf->tlines[line];
+
+    if (line < buf->wstart || line >= buf->wstart + buf->wlength)
+        window_load(buf, line);
+
+    return buf->wlines[line - buf->wstart];
+}
+
+/* search_get_line: Gets a line of a buffer for hl_regex to search. */
+static const char *search_get_line(void *data, int line)
+{
+    return buffer_line((struct buffer *) data, line);
+}
+
+/* buffer_spans: Gets the spans of a line of a large file.
+ * -------------
+ *
+ * The lines in the window are highlighted the first time one of them is
+ * drawn, and again when the language of the file changes.
+ *
+ *   node:  The large file
+ *   line:  The line number, which must be in the window
+ *
+ * Return Value:  The spans, or NULL if the line is drawn without color.
+ */
+static struct hl_span *buffer_spans(struct list_node *node, int line)
+{
+    struct buffer *buf = &node->buf;
+
+    if (buf->wspans && buf->wlanguage != node->language) {
+        highlight_block_free(buf->wspans, buf->wlength);
+        buf->wspans = NULL;
+        buf->wspans_size = 0;
+    }
+
+    if (!buf->wspans) {
+        buf->wspans = highlight_block(node->language, buf->wlines,
+                buf->wlength, &buf->wspans_size);
+        buf->wlanguage = node->language;
+    }
+
+    return buf->wspans ? buf->wspans[line - buf->wstart] : NULL;
+}
+
+/* load_file:  Loads the file in the list_node into its memory buffer.
+ * ----------
+ *
+ *   node:  The list node to work on
+ *
+ * Return Value:  Zero on success, non-zero on error.
+ */
+static int load_file(struct list_node *node)
+{
+    init_file_buffer(&node->buf);
+
+    /* Stat the file to get the timestamp */
+    if (get_timestamp(node->path, &(node->last_modification)) == -1)
+        return 2;
+
+    if (read_file(node->path, &node->buf))
+        return 1;
+
+    node->language = tokenizer_get_default_file_type(strrchr(node->path, '.'));
+
+    /* Lines are highlighted when they are displayed */
+    highlight(node);
+
+    return 0;
+}
+
+/* diff_same: Checks if a line of a file is the same in a new version of it.
+ * ----------
+ *
+ * The hashes are compared first, and the text only when they match, since
+ * different lines can have the same hash.
+ *
+ *   old: The old version of the file
+ *   i:   The old line
+ *   new: The new version of the file
+ *   j:   The new line
+ *
+ * Return Value:  1 if the lines are the same, 0 otherwise.
+ */
+static int diff_same(const struct buffer *old, int i,
+        const struct buffer *new, int j)
+{
+    return old->hashes[i] == new->hashes[j] &&
+            strcmp(old->tlines[i], new->tlines[j]) == 0;
+}
+
+/* diff_middle: Finds the lines two versions of a file have in common.
+ * ------------
+ *
+ * This is the O(ND) algorithm of Myers, which is fast when the versions
+ * differ in only a few lines.  When they differ in more than DIFF_MAX_EDITS
+ * lines, it gives up.
+ *
+ *   old:    The old version of the file
+ *   new:    The new version of the file
+ *   start:  The first line compared, in both versions
+ *   n:      The number of old lines compared
+ *   m:      The number of new lines compared
+ *   map:    Set to the old line each of the new lines compared is the
+ *           same as, starting with line start
+ *
+ * Return Value:  Zero on success, or -1 if the versions differ too much.
+ */
+static int diff_middle(const struct buffer *old, const struct buffer *new,
+        int start, int n, int m, int *map)
+{
+    int max = n + m < DIFF_MAX_EDITS ? n + m : DIFF_MAX_EDITS;
+    int *diagonals = cgdb_malloc(sizeof (int) * (2 * max + 3));
+    int *v = diagonals + max + 1;
+    int **trace = cgdb_malloc(sizeof (int *) * (max + 1));
+    int d, k, x, y, pk, px, py, found = -1;
+
+    /* v[k] is the furthest x reached on diagonal k = x - y so far. The
+     * diagonals reached with d edits are kept in trace[d], to walk back. */
+    v[1] = 0;
+    for (d = 0; d <= max && found == -1; d++) {
+        for (k = -d; k <= d; k += 2) {
+            if (k == -d || (k != d && v[k - 1] < v[k + 1]))
+                x = v[k + 1];
+            else
+                x = v[k - 1] + 1;
+            y = x - k;
+
+            while (x < n && y < m &&
+                    diff_same(old, start + x, new, start + y)) {
+                x++;
+                y++;
+            }
+            v[k] = x;
+
+            if (x >= n && y >= m) {
+                found = d;
+                break;
+            }
+        }
+
+        trace[d] = cgdb_malloc(sizeof (int) * (2 * d + 1));
+        memcpy(trace[d], &v[-d], sizeof (int) * (2 * d + 1));
+    }
+
+    if (found != -1) {
+        x = n;
+        y = m;
+        for (k = found; k > 0; k--) {
+            int *pv = trace[k - 1] + k - 1;
+
+            if (x - y == -k || (x - y != k &&
+                            pv[x - y - 1] < pv[x - y + 1]))
+                pk = x - y + 1;
+            else
+                pk = x - y - 1;
+            px = pv[pk];
+            py = px - pk;
+
+            while (x > px && y > py) {
+                x--;
+                y--;
+                map[y] = x + start;
+            }
+
+            x = px;
+            y = py;
+        }
+
+        while (x > 0 && y > 0) {
+            x--;
+            y--;
+            map[y] = x + start;
+        }
+    }
+
+    while (d-- > 0)
+        free(trace[d]);
+    free(trace);
+    free(diagonals);
+
+    return found != -1 ? 0 : -1;
+}
+
+/* diff_lines: Finds the lines a file has in common with a new version of it.
+ * -----------
+ *
+ * Lines are compared with diff_same.  The lines at the start and the end
+ * that did not change are skipped first, since usually only a few lines in
+ * the middle change.
+ *
+ *   old:     The old version of the file
+ *   new:     The new version of the file
+ *   similar: Returns 0 if the versions differ too much to be compared line
+ *            by line, or either is a large file, in which case the lines in
+ *            the middle are all taken to have changed, or 1 otherwise
+ *
+ * Return Value:  For each line of new, the line of old it is the same as,
+ *                or -1 if it changed.  This must be freed.
+ */
+static int *diff_lines(struct buffer *old, struct buffer *new, int *similar)
+{
+    int *new_to_old = cgdb_malloc(sizeof (int) * (new->length + 1));
+    int prefix = 0, suffix = 0, i;
+
+    *similar = 1;
+
+    for (i = 0; i < new->length; i++)
+        new_to_old[i] = -1;
+
+    /* Large files have no hashes to compare */
+    if (!old->hashes || !new->hashes) {
+        *similar = 0;
+        return new_to_old;
+    }
+
+    while (prefix < old->length && prefix < new->length &&
+            diff_same(old, prefix, new, prefix)) {
+        new_to_old[prefix] = prefix;
+        prefix++;
+    }
+
+    while (suffix < old->length - prefix && suffix < new->length - prefix &&
+            diff_same(old, old->length - suffix - 1,
+                    new, new->length - suffix - 1)) {
+        new_to_old[new->length - suffix - 1] = old->length - suffix - 1;
+        suffix++;
+    }
+
+    if (old->length - prefix - suffix > 0 &&
+            new->length - prefix - suffix > 0 &&
+            diff_middle(old, new, prefix, old->length - prefix - suffix,
+                    new->length - prefix - suffix, new_to_old + prefix) == -1)
+        *similar = 0;
+
+    return new_to_old;
+}
+
+/* diff_map_line: Finds where a line went in a new version of a file.
+ * --------------
+ *
+ * A line that was removed or changed goes to the line after the last line
+ * in front of it that is in both versions.
+ *
+ *   old_to_new: For each old line, the new line it is the same as, or -1.
+ *               If NULL, lines keep their line numbers.
+ *   old_length: The number of old lines
+ *   new_length: The number of new lines
+ *   line:       The old line
+ *
+ * Return Value:  The new line.
+ */
+static int diff_map_line(const int *old_to_new, int old_length,
+        int new_length, int line)
+{
+    int i, result;
+
+    if (line >= old_length)
+        line = old_length - 1;
+
+    for (i = line; old_to_new && i >= 0 && old_to_new[i] == -1; i--);
+
+    if (!old_to_new)
+        result = line;
+    else if (i < 0)
+        result = 0;
+    else if (i == line)
+        result = old_to_new[i];
+    else
+        result = old_to_new[i] + 1;
+
+    if (result >= new_length)
+        result = new_length > 0 ? new_length - 1 : 0;
+
+    return result;
+}
+
+/* buffer_memory: Computes the number of bytes used by a loaded buffer.
+ * --------------
+ *
+ *   buf:  The buffer to measure
+ *
+ * Return Value:  The number of bytes used by the lines of the buffer.
+ */
+static size_t buffer_memory(struct buffer *buf)
+{
+    size_t size = sizeof (char *) * buf->length;
+    int i;
+
+    /* The text of a large file is not counted, since only the lines in the
+     * window are kept in memory */
+    if (buf->large) {
+        int blocks = (buf->length + SOURCE_LARGE_BLOCK - 1) /
+                SOURCE_LARGE_BLOCK;
+        int first = buf->wstart / SOURCE_LARGE_BLOCK;
+        int last = (buf->wstart + buf->wlength + SOURCE_LARGE_BLOCK - 1) /
+                SOURCE_LARGE_BLOCK;
+
+        size = sizeof (size_t) * (blocks + 1);
+        if (buf->window)
+            size += buf->blocks[last] - buf->blocks[first] + 1 +
+                    sizeof (char *) * buf->wlength + buf->wspans_size;
+        return size;
+    }
+
+    if (buf->text) {
+        size += buf->text_size;
+    } else {
+        for (i = 0; i < buf->length; i++)
+            if (buf->tlines[i])
+                size += strlen(buf->tlines[i]) + 1;
+    }
+
+    if (buf->hashes)
+        size += sizeof (unsigned int) * buf->length;
+
+    return size;
+}
+
+/* lru_unlink: Removes a loaded file from the least recently used list.
+ * -----------
+ */
+static void lru_unlink(struct sviewer *sview, struct list_node *node)
+{
+    if (node->lru_prev)
+        node->lru_prev->lru_next = node->lru_next;
+    else
+        sview->lru_head = node->lru_next;
+
+    if (node->lru_next)
+        node->lru_next->lru_prev = node->lru_prev;
+    else
+        sview->lru_tail = node->lru_prev;
+
+    node->lru_prev = NULL;
+    node->lru_next = NULL;
+}
+
+/* lru_push: Puts a loaded file at the front of the least recently used list.
+ * ---------
+ */
+static void lru_push(struct sviewer *sview, struct list_node *node)
+{
+    node->lru_prev = NULL;
+    node->lru_next = sview->lru_head;
+
+    if (sview->lru_head)
+        sview->lru_head->lru_prev = node;
+    else
+        sview->lru_tail = node;
+
+    sview->lru_head = node;
+}
+
+/* lru_append: Puts a loaded file at the back of the least recently used list.
+ * -----------
+ */
+static void lru_append(struct sviewer *sview, struct list_node *node)
+{
+    node->lru_prev = sview->lru_tail;
+    node->lru_next = NULL;
+
+    if (sview->lru_tail)
+        sview->lru_tail->lru_next = node;
+    else
+        sview->lru_head = node;
+
+    sview->lru_tail = node;
+}
+
+/* is_loaded: Checks to see if a file is currently loaded into memory.
+ * ----------
+ *
+ * Return Value: 1 if the file is loaded, 0 otherwise.
+ */
+static int is_loaded(struct sviewer *sview, struct list_node *node)
+{
+    return node->lru_prev != NULL || sview->lru_head == node;
+}
+
+#if HAVE_SYS_INOTIFY_H
+/* The events that mean a watched file changed.  When the file is moved or
+ * deleted, the watch goes with it, so the file is watched again after it is
+ * read again. */
+#define SOURCE_WATCH_EVENTS \
+        (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+#endif /* HAVE_SYS_INOTIFY_H */
+
+/* source_remote: Checks if a file is on a network file system.
+ * --------------
+ *
+ * inotify only reports the changes made on this machine, so a change made
+ * by another client of a network file system would never be seen.
+ *
+ *   path:  The file
+ *
+ * Return Value:  Nonzero if the file is on a network or FUSE file system.
+ */
+static int source_remote(const char *path)
+{
+#if HAVE_SYS_VFS_H
+    static const unsigned int remote[] = {
+        0x6969,                 /* NFS */
+        0x517b,                 /* SMB */
+        0xff534d42,             /* CIFS */
+        0xfe534d42,             /* SMB2 */
+        0x65735546,             /* FUSE, such as sshfs */
+        0x01021997,             /* 9P */
+        0x5346414f,             /* AFS */
+        0x6b414653,             /* kAFS */
+        0x73757245,             /* Coda */
+        0x00c36400,             /* Ceph */
+        0x0bd00bd0,             /* Lustre */
+        0x01161970,             /* GFS2 */
+        0x7461636f              /* OCFS2 */
+    };
+    struct statfs st;
+    int i;
+
+    if (statfs(path, &st) == -1)
+        return 0;
+
+    for (i = 0; i < (int) (sizeof (remote) / sizeof (remote[0])); i++)
+        if ((unsigned int) st.f_type == remote[i])
+            return 1;
+#endif /* HAVE_SYS_VFS_H */
+
+    return 0;
+}
+
+/* source_watch: Starts watching a file that was just read for changes.
+ * -------------
+ *
+ * If the file can not be watched, or is on a network file system, it is
+ * polled instead.
+ *
+ *   sview:  The source viewer object
+ *   node:   The loaded file
+ */
+static void source_watch(struct sviewer *sview, struct list_node *node)
+{
+    node->changed = 0;
+    node->last_check = time(NULL);
+
+#if HAVE_SYS_INOTIFY_H
+    if (sview->watch_fd != -1 && node->watch == -1 &&
+            !source_remote(node->path))
+        node->watch = inotify_add_watch(sview->watch_fd, node->path,
+                SOURCE_WATCH_EVENTS);
+#endif /* HAVE_SYS_INOTIFY_H */
+}
+
+/* source_unwatch: Stops watching a file for changes.
+ * ---------------
+ *
+ *   sview:  The source viewer object
+ *   node:   The file
+ */
+static void source_unwatch(struct sviewer *sview, struct list_node *node)
+{
+#if HAVE_SYS_INOTIFY_H
+    if (node->watch != -1)
+        inotify_rm_watch(sview->watch_fd, node->watch);
+#endif /* HAVE_SYS_INOTIFY_H */
+
+    node->watch = -1;
+}
+
+/* source_changed: Checks to see if a loaded file may have changed since it
+ * --------------- was read, without going to the file system.
+ *
+ *   sview:  The source viewer object
+ *   node:   The loaded file
+ *
+ * Return Value: 1 if the file may have changed, 0 if it did not.
+ */
+static int source_changed(struct sviewer *sview, struct list_node *node)
+{
+    time_t now;
+
+    /* The main loop may not have picked up the latest events yet */
+    source_watch_ready(sview);
+
+    if (node->changed)
+        return 1;
+
+    if (node->watch != -1)
+        return 0;
+
+    now = time(NULL);
+    if (now - node->last_check < SOURCE_POLL_INTERVAL)
+        return 0;
+
+    node->last_check = now;
+
+    return 1;
+}
+
+/* find_break: Finds where a breakpoint is, or would go, in the breakpoints
+ * -----------  of a file.
+ *
+ *   node:   The file
+ *   line:   The line of the breakpoint (0-based)
+ *
+ * Return Value:  The index of the first breakpoint at or after line.
+ */
+static int find_break(struct list_node *node, int line)
+{
+    int low = 0, high = node->breakpts_length;
+
+    while (low < high) {
+        int mid = (low + high) / 2;
+
+        if (node->breakpts[mid].line < line)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+/* get_break: Gets the breakpoint on a line of a file.
+ * ----------
+ *
+ * Return Value:  0 if there is no breakpoint, 1 if it is enabled, or 2 if
+ *                it is disabled.
+ */
+static int get_break(struct list_node *node, int line)
+{
+    int i = find_break(node, line);
+
+    if (i < node->breakpts_length && node->breakpts[i].line == line)
+        return node->breakpts[i].state;
+
+    return 0;
+}
+
+/* set_break: Sets a breakpoint of a file.
+ * ----------
+ *
+ *   sview:  The source viewer object
+ *   node:   The file the breakpoint is in
+ *   line:   The line of the breakpoint (0-based)
+ *   state:  1 if enabled, 2 if disabled
+ */
+static void set_break(struct sviewer *sview, struct list_node *node,
+        int line, char state)
+{
+    int i = find_break(node, line);
+
+    if (i < node->breakpts_length && node->breakpts[i].line == line) {
+        node->breakpts[i].state = state;
+        return;
+    }
+
+    if (node->breakpts_length == 0) {
+        node->break_next = sview->break_head;
+        sview->break_head = node;
+    }
+
+    node->breakpts = cgdb_realloc(node->breakpts,
+            sizeof (struct source_breakpt) * (node->breakpts_length + 1));
+    memmove(node->breakpts + i + 1, node->breakpts + i,
+            sizeof (struct source_breakpt) * (node->breakpts_length - i));
+    node->breakpts[i].line = line;
+    node->breakpts[i].state = state;
+    node->breakpts_length++;
+}
+
+/* source_account: Counts the memory used by a loaded file again.
+ * ---------------
+ *
+ *   sview:  The source viewer object
+ *   node:   The loaded file
+ */
+static void source_account(struct sviewer *sview, struct list_node *node)
+{
+    sview->memory -= node->memory;
+    node->memory = buffer_memory(&node->buf) + highlight_memory(node);
+    sview->memory += node->memory;
+}
+
+/* damage_lines: Makes source_display draw the rows showing some lines again.
+ * -------------
+ *
+ *   sview:  The source viewer object
+ *   node:   The file the lines are in
+ *   start:  The first line that changed
+ *   end:    One past the last line that changed
+ */
+static void damage_lines(struct sviewer *sview, struct list_node *node,
+        int start, int end)
+{
+    struct source_screen *screen = &sview->screen;
+    int i;
+
+    if (screen->node != node)
+        return;
+
+    for (i = 0; i < screen->height; i++)
+        if (screen->rows[i].line >= start && screen->rows[i].line < end)
+            screen->rows[i].node = NULL;
+}
+
+/* damage_node: Makes source_display draw every row if it shows a file.
+ * ------------
+ *
+ *   sview:  The source viewer object
+ *   node:   The file that changed
+ */
+static void damage_node(struct sviewer *sview, struct list_node *node)
+{
+    if (sview->screen.node == node)
+        sview->screen.node = NULL;
+}
+
+/* source_forget_matches: Frees the hlsearch matches found in a file.
+ * ----------------------
+ *
+ *   sview:  The source viewer object
+ *   node:   The file that changed, or NULL for every file
+ */
+static void source_forget_matches(struct sviewer *sview,
+        struct list_node *node)
+{
+    int i;
+
+    for (i = 0; i < SOURCE_HLS_LINES; i++) {
+        struct source_hls_line *entry = &sview->hls_lines[i];
+
+        if (entry->node && (!node || entry->node == node)) {
+            free(entry->matches);
+            entry->node = NULL;
+            entry->matches = NULL;
+        }
+    }
+}
+
+/* source_unload: Unloads a file, keeping the data that describes it.
+ * --------------
+ *
+ * The text of the file is released.  The breakpoints and the selection
+ * are kept for when the file is loaded again.
+ *
+ *   sview:  The source viewer object
+ *   node:   The loaded file to unload
+ */
+static void source_unload(struct sviewer *sview, struct list_node *node)
+{
+    release_file_memory(node);
+    source_unwatch(sview, node);
+    damage_node(sview, node);
+    source_forget_matches(sview, node);
+    hl_regex_forget(&node->buf);
+
+    lru_unlink(sview, node);
+    sview->memory -= node->memory;
+    node->memory = 0;
+}
+
+/* source_trim_memory: Unloads the least recently used files until the
+ * -------------------  loaded files fit in the maxmemtot budget.
+ *
+ *   sview:  The source viewer object
+ *   keep:   A file that should not be unloaded (may be NULL)
+ */
+static void source_trim_memory(struct sviewer *sview, struct list_node *keep)
+{
+    size_t budget =
+            (size_t) cgdbrc_get(CGDBRC_MAXMEMTOT)->variant.int_val * 1024;
+    struct list_node *node = sview->lru_tail;
+    struct list_node *prev;
+
+    /* A budget of 0 means files are never unloaded */
+    if (budget == 0)
+        return;
+
+    while (node && sview->memory > budget) {
+        prev = node->lru_prev;
+
+        if (node != keep && node != sview->cur)
+            source_unload(sview, node);
+
+        node = prev;
+    }
+}
+
+/* source_highlight: Highlights a range of lines of a loaded file.
+ * -----------------
+ *
+ *   sview:  The source viewer object
+ *   node:   The loaded file
+ *   start:  The first line to highlight
+ *   end:    One past the last line to highlight
+ */
+static void source_highlight(struct sviewer *sview, struct list_node *node,
+        int start, int end)
+{
+    long bytes = highlight_lines(node, start, end);
+
+    node->memory += bytes;
+    sview->memory += bytes;
+
+    if (bytes > 0) {
+        damage_node(sview, node);
+        source_trim_memory(sview, node);
+    }
+}
+
+/* source_read: Loads a file, without putting it in the least recently used
+ * ------------  list.
+ *
+ * The saved breakpoints of the file are restored.
+ *
+ *   sview:  The source viewer object
+ *   node:   The file to load
+ *
+ * Return Value:  Zero on success, non-zero on error.
+ */
+static int source_read(struct sviewer *sview, struct list_node *node)
+{
+    if (load_file(node)) {
+        release_file_memory(node);
+        return 1;
+    }
+
+    /* The file may have become shorter since it was last loaded */
+    if (node->sel_line >= node->buf.length) {
+        node->sel_line = node->buf.length > 0 ? node->buf.length - 1 : 0;
+        node->sel_rline = node->sel_line;
+    }
+
+    node->memory = buffer_memory(&node->buf) + highlight_memory(node);
+    sview->memory += node->memory;
+    damage_node(sview, node);
+    source_watch(sview, node);
+
+    return 0;
+}
+
+/* source_load: Loads a file and makes it the most recently used.
+ * ------------
+ *
+ * The saved breakpoints of the file are restored, and other files are
+ * unloaded if this one takes the source viewer over its memory budget.
+ *
+ *   sview:  The source viewer object
+ *   node:   The file to load
+ *
+ * Return Value:  Zero on success, non-zero on error.
  */
-static struct list_node *get_node(struct sviewer *sview, const char *path)
+static int source_load(struct sviewer *sview, struct list_node *node)
 {
-    struct list_node *cur;
+    if (source_read(sview, node))
+        return 1;
 
-    for (cur = sview->list_head; cur != NULL; cur = cur->next)
-        if (cur->path)
-            if (strcmp(path, cur->path) == 0)
-                return cur;
+    lru_push(sview, node);
+    source_trim_memory(sview, node);
 
-    return NULL;
+    return 0;
 }
 
-/**
- * Get's the timestamp of a particular file.
+/* source_update: Reads a loaded file again after it changed.
+ * --------------
  *
- * \param path
- * The path to the file to get the timestamp of
+ * The new lines are compared with the old, so that only the lines that
+ * changed have to be highlighted again, and the breakpoints and the
+ * selected line stay on the lines they were on.  The lines are compared
+ * by their hashes, and by their text when the hashes match.
  *
- * \param timestamp
- * The timestamp of the file, or 0 on error.
- * 
- * \return
- * 0 on success, -1 on error.
+ *   sview:     The source viewer object
+ *   node:      The loaded file
+ *   timestamp: The modification time of the file
+ *
+ * Return Value:  Zero on success, non-zero on error.
  */
-static int get_timestamp(const char *path, time_t * timestamp)
+static int source_update(struct sviewer *sview, struct list_node *node,
+        time_t timestamp)
 {
-    struct stat s;
-    int val;
+    struct buffer old = node->buf;
+    struct buffer buf;
+    int *new_to_old, *old_to_new;
+    int i, k, similar;
 
-    if (!path)
-        return -1;
+    if (read_file(node->path, &buf)) {
+        release_file_buffer(&buf);
+        return 1;
+    }
 
-    if (!timestamp)
-        return -1;
+    /* The path may name a new file now, if it was replaced */
+    source_unwatch(sview, node);
+    source_watch(sview, node);
+
+    new_to_old = diff_lines(&old, &buf, &similar);
+
+    /* When the file was rewritten, lines keep their line numbers */
+    old_to_new = NULL;
+    if (similar) {
+        old_to_new = cgdb_malloc(sizeof (int) * (old.length + 1));
+        for (i = 0; i < old.length; i++)
+            old_to_new[i] = -1;
+        for (i = 0; i < buf.length; i++)
+            if (new_to_old[i] != -1)
+                old_to_new[new_to_old[i]] = i;
+    }
 
-    *timestamp = 0;
+    /* Lines stay in order, so the breakpoints do too.  Breakpoints that
+     * end up on the same line are merged.  A breakpoint past the end of the
+     * file stays as far past the end. */
+    if (old.length > 0 && buf.length > 0) {
+        for (i = 0, k = 0; i < node->breakpts_length; i++) {
+            int line = node->breakpts[i].line;
+
+            if (line < old.length)
+                line = diff_map_line(old_to_new, old.length, buf.length,
+                        line);
+            else
+                line += buf.length - old.length;
+
+            if (k > 0 && node->breakpts[k - 1].line == line)
+                k--;
+            node->breakpts[k].line = line;
+            node->breakpts[k++].state = node->breakpts[i].state;
+        }
+        node->breakpts_length = k;
+    }
 
-    val = stat(path, &s);
+    node->sel_line = diff_map_line(old_to_new, old.length, buf.length,
+            node->sel_line);
+    node->sel_rline = diff_map_line(old_to_new, old.length, buf.length,
+            node->sel_rline);
+    node->last_modification = timestamp;
 
-    if (val)                    /* Error on timestamp */
-        return -1;
+    /* The highlighting still refers to the old lines until it is moved */
+    node->buf = buf;
+    highlight_reload(node, new_to_old, old.length);
+    damage_node(sview, node);
+    source_forget_matches(sview, node);
+    hl_regex_forget(&node->buf);
+    release_file_buffer(&old);
 
-    *timestamp = s.st_mtime;
+    free(new_to_old);
+    free(old_to_new);
+
+    source_account(sview, node);
+
+    source_trim_memory(sview, node);
 
     return 0;
 }
 
-static int release_file_buffer(struct buffer *buf)
+/* source_matches: Gets the matches of the hlsearch pattern on a line.
+ * ---------------
+ *
+ * The line is searched the first time it is asked for, and the matches are
+ * kept until the pattern or the file changes, or another line that was
+ * drawn takes their place.
+ *
+ *   sview:  The current source viewer
+ *   line:   The line number
+ *
+ * Return Value: The matches, or NULL if none are highlighted.
+ */
+static struct hl_match *source_matches(struct sviewer *sview, int line)
 {
-    int i;
+    struct source_hls_line *entry;
 
-    /* Nothing to free */
-    if (!buf)
-        return 0;
+    if (!sview->screen.hlsearch)
+        return NULL;
 
-    for (i = 0; i < buf->length; ++i) {
-        free(buf->tlines[i]);
-        buf->tlines[i] = NULL;
+    if (sview->hls_cached != sview->hls_generation) {
+        source_forget_matches(sview, NULL);
+        sview->hls_cached = sview->hls_generation;
     }
 
-    free(buf->tlines);
-    buf->tlines = NULL;
-    buf->length = 0;
-    buf->cur_line = NULL;
-    buf->max_width = 0;
-    free(buf->breakpts);
-    buf->breakpts = NULL;
+    entry = &sview->hls_lines[line % SOURCE_HLS_LINES];
+    if (entry->node != sview->cur || entry->line != line) {
+        free(entry->matches);
+        entry->node = sview->cur;
+        entry->line = line;
+        entry->matches = hl_regex_matches(sview->hls_regex,
+                sview->hls_icase, buffer_line(&sview->cur->buf, line));
+    }
 
-    return 0;
+    return entry->matches;
 }
 
-/** 
- * Remove's the memory related to a file.
+/* source_print_line: Prints a line of the current file.
+ * ------------------
  *
- * \param node
- * The node who's file buffer data needs to be freed.
+ * Lines that are not highlighted yet are printed without color.  A search
+ * match on the selected line is highlighted, and so are the matches of the
+ * hlsearch pattern.
  *
- * \return
- * 0 on success, or -1 on error.
+ *   sview:  The current source viewer
+ *   line:   The line number
+ *   width:  The maximum width of the line
+ *   offset: Character (in line) to start at
  */
-static int release_file_memory(struct list_node *node)
+static void source_print_line(struct sviewer *sview, int line, int width,
+        int offset)
 {
-    if (!node)
-        return -1;
+    struct list_node *node = sview->cur;
+    struct hl_span *spans = NULL;
+    struct hl_match *matches = source_matches(sview, line);
 
-    /* Free the buffer */
-    if (release_file_buffer(&node->buf) == -1)
-        return -1;
+    char *text = buffer_line(&node->buf, line);
 
-    if (release_file_buffer(&node->orig_buf) == -1)
-        return -1;
+    if (sources_syntax_on && node->buf.large)
+        spans = buffer_spans(node, line);
+    else if (sources_syntax_on && node->hl_spans)
+        spans = node->hl_spans[line];
 
-    return 0;
+    if (line == node->sel_line)
+        hl_wprintw(sview->win, text, spans, matches, width, offset,
+                node->buf.match_beg, node->buf.match_end);
+    else
+        hl_wprintw(sview->win, text, spans, matches, width, offset, -1, -1);
 }
 
-/* load_file:  Loads the file in the list_node into its memory buffer.
- * ----------
+/* source_top_line: Gets the line at the top of the window.
+ * ----------------
  *
- *   node:  The list node to work on
+ * The selected line is centered, unless the file is too small or it is
+ * near the start or end of the file.
  *
- * Return Value:  Zero on success, non-zero on error.
+ *   node:    The loaded file
+ *   height:  The height of the window
  */
-static int load_file(struct list_node *node)
+static int source_top_line(struct list_node *node, int height)
 {
-    FILE *file;
-    char line[MAX_LINE];
-    int i;
-
-    node->buf.length = 0;
-    node->buf.tlines = NULL;
-    node->buf.breakpts = NULL;
-    node->buf.cur_line = NULL;
-    node->buf.max_width = 0;
-
-    /* Open file and save in original buffer.
-     * I am not sure if this should be done this way in the future.
-     * Maybe this data should be recieved from flex.
-     */
-    node->orig_buf.length = 0;
-    node->orig_buf.tlines = NULL;
-    node->orig_buf.breakpts = NULL;
-    node->orig_buf.cur_line = NULL;
-    node->orig_buf.max_width = 0;
-
-    /* Stat the file to get the timestamp */
-    if (get_timestamp(node->path, &(node->last_modification)) == -1)
-        return 2;
-
-    if (!(file = fopen(node->path, "r")))
-        return 1;
-
-    while (!feof(file)) {
-        if (fgets(line, MAX_LINE, file)) {
-            int length = strlen(line);
-
-            if (length > 0) {
-                if (line[length - 1] == '\n')
-                    line[length - 1] = 0;
-                if (line[length - 1] == '\r')
-                    line[length - 1] = 0;
-            }
-            if (strlen(line) > node->orig_buf.max_width)
-                node->orig_buf.max_width = strlen(line);
-
-            /* Inefficient - Reallocates memory at each line */
-            node->orig_buf.length++;
-            node->orig_buf.tlines = realloc(node->orig_buf.tlines,
-                    sizeof (char *) * node->orig_buf.length);
-            node->orig_buf.tlines[node->orig_buf.length - 1] = strdup(line);
-        }
-    }
-
-    fclose(file);
-
-    node->language = tokenizer_get_default_file_type(strrchr(node->path, '.'));
-
-    /* Add the highlighted lines */
-    if (has_colors()) {
-        highlight(node);
-    } else {
-        /* Just copy the lines from the original buffer if no highlighting 
-         * is possible */
-        int i;
+    int line;
 
-        node->buf.length = node->orig_buf.length;
-        node->buf.max_width = node->orig_buf.max_width;
-        node->buf.tlines = cgdb_malloc(sizeof (char *) * node->orig_buf.length);
-        for (i = 0; i < node->orig_buf.length; i++)
-            node->buf.tlines[i] = cgdb_strdup(node->orig_buf.tlines[i]);
-    }
+    if (node->buf.length < height)
+        return (node->buf.length - height) / 2;
 
-    /* Allocate the breakpoints array */
-    node->buf.breakpts = malloc(sizeof (char) * node->buf.length);
-    for (i = 0; i < node->buf.length; i++)
-        node->buf.breakpts[i] = 0;
+    line = node->sel_line - height / 2;
+    if (line > node->buf.length - height)
+        line = node->buf.length - height;
+    else if (line < 0)
+        line = 0;
 
-    return 0;
+    return line;
 }
 
 /* draw_current_line:  Draws the currently executing source line on the screen
@@ -301,9 +1563,7 @@ static void draw_current_line(struct sviewer *sview, int line, int lwidth)
     int height = 0;             /* Height of curses window */
     int width = 0;              /* Width of curses window */
     int i = 0, j = 0;           /* Iterators */
-    struct buffer *buf = NULL;  /* Pointer to the source buffer */
-    char *text = NULL;          /* The current line (highlighted) */
-    char *otext = NULL;         /* The current line (unhighlighted) */
+    char *otext = NULL;         /* The current line */
     unsigned int length = 0;    /* Length of the line */
     int column_offset = 0;      /* Text to skip due to arrow */
     int arrow_attr;
@@ -322,20 +1582,7 @@ static void draw_current_line(struct sviewer *sview, int line, int lwidth)
     /* Initialize height and width */
     getmaxyx(sview->win, height, width);
 
-    /* If syntax highlighting is on, point to the colored buffer. */
-    if (sources_syntax_on) {
-        buf = &(sview->cur->buf);
-    } else {
-        buf = &(sview->cur->orig_buf);
-    }
-
-    /* If the current selected line is the line executing, use cur_line */
-    if (line == sview->cur->sel_line && buf->cur_line != NULL) {
-        text = buf->cur_line;
-    } else {
-        text = buf->tlines[line];
-    }
-    otext = sview->cur->orig_buf.tlines[line];
+    otext = buffer_line(&sview->cur->buf, line);
     length = strlen(otext);
 
     /* Draw the appropriate arrow, if applicable */
@@ -385,12 +1632,19 @@ static void draw_current_line(struct sviewer *sview, int line, int lwidth)
             waddch(sview->win, VERT_LINE);
             waddch(sview->win, ' ');
 
+            /* Expand tabs here, since curses would not stop them at the
+             * edge of the window */
             wattron(sview->win, highlight_attr);
-            for (i = 0; i < width - lwidth - 2; i++) {
-                if (i < length) {
-                    waddch(sview->win, otext[i]);
+            for (i = 0, j = 0; j < width - lwidth - 2; i++) {
+                if (i < length && otext[i] == '\t') {
+                    do {
+                        waddch(sview->win, ' ');
+                        j++;
+                    } while (j % highlight_tabstop > 0 &&
+                            j < width - lwidth - 2);
                 } else {
-                    waddch(sview->win, ' ');
+                    waddch(sview->win, i < length ? otext[i] : ' ');
+                    j++;
                 }
             }
             wattroff(sview->win, highlight_attr);
@@ -398,11 +1652,133 @@ static void draw_current_line(struct sviewer *sview, int line, int lwidth)
             return;
     }
 
-    /* Finally, print the source line */
-    hl_wprintw(sview->win, text, width - lwidth - 2,
+    /* Finally, print the source line after the arrow */
+    source_print_line(sview, line, width - lwidth - 2 - column_offset,
             sview->cur->sel_col + column_offset);
 }
 
+/* screen_prepare: Finds the rows source_display has to draw.
+ * ---------------
+ *
+ * If anything that every row depends on changed, every row is marked to be
+ * drawn.  If the lines only moved up or down, the window is scrolled so
+ * that the terminal can scroll too, and only the new rows are drawn.
+ *
+ *   sview:   The source viewer object
+ *   top:     The line to draw on the first row
+ *   height:  The height of the window
+ *   width:   The width of the window
+ *   lwidth:  The width of the line numbers
+ *   focus:   If the window has focus
+ */
+static void screen_prepare(struct sviewer *sview, int top, int height,
+        int width, int lwidth, int focus)
+{
+    struct source_screen *screen = &sview->screen;
+    struct list_node *node = sview->cur;
+    int tabstop = cgdbrc_get(CGDBRC_TABSTOP)->variant.int_val;
+    int arrowstyle = cgdbrc_get(CGDBRC_ARROWSTYLE)->variant.arrow_style;
+    int wstart = node->buf.large ? node->buf.wstart : 0;
+    int icase = cgdbrc_get(CGDBRC_IGNORECASE)->variant.int_val;
+    unsigned long hlsearch = 0;
+    int shift = height;
+    int i;
+
+    /* The matches are found again when the case of the letters matters */
+    if (sview->hls_regex && icase != sview->hls_icase) {
+        sview->hls_icase = icase;
+        sview->hls_generation++;
+    }
+
+    if (sview->hls_regex && cgdbrc_get(CGDBRC_HLSEARCH)->variant.int_val)
+        hlsearch = sview->hls_generation;
+
+    if (screen->height != height) {
+        screen->rows = cgdb_realloc(screen->rows,
+                sizeof (struct source_row) * height);
+        screen->height = height;
+        screen->node = NULL;
+    }
+
+    if (screen->node == node && screen->width == width &&
+            screen->lwidth == lwidth && screen->focus == focus &&
+            screen->tabstop == tabstop && screen->arrowstyle == arrowstyle &&
+            screen->syntax == sources_syntax_on &&
+            screen->language == node->language &&
+            screen->wstart == wstart && screen->hlsearch == hlsearch &&
+            has_colors())
+        shift = top - screen->top;
+
+    if (shift >= height || shift <= -height) {
+        for (i = 0; i < height; i++)
+            screen->rows[i].node = NULL;
+    } else if (shift > 0) {
+        scrollok(sview->win, TRUE);
+        wscrl(sview->win, shift);
+        scrollok(sview->win, FALSE);
+        memmove(screen->rows, screen->rows + shift,
+                sizeof (struct source_row) * (height - shift));
+        for (i = height - shift; i < height; i++)
+            screen->rows[i].node = NULL;
+    } else if (shift < 0) {
+        scrollok(sview->win, TRUE);
+        wscrl(sview->win, shift);
+        scrollok(sview->win, FALSE);
+        memmove(screen->rows - shift, screen->rows,
+                sizeof (struct source_row) * (height + shift));
+        for (i = 0; i < -shift; i++)
+            screen->rows[i].node = NULL;
+    }
+
+    screen->node = node;
+    screen->top = top;
+    screen->width = width;
+    screen->lwidth = lwidth;
+    screen->focus = focus;
+    screen->tabstop = tabstop;
+    screen->arrowstyle = arrowstyle;
+    screen->syntax = sources_syntax_on;
+    screen->language = node->language;
+    screen->wstart = wstart;
+    screen->hlsearch = hlsearch;
+}
+
+/* screen_row_changed: Checks if a row has to be drawn, and remembers what
+ * -------------------  will be drawn on it.
+ *
+ *   sview:    The source viewer object
+ *   row:      The row of the window
+ *   line:     The line to draw on the row
+ *   breakpt:  The breakpoint on the line
+ *
+ * Return Value:  Nonzero if the row has to be drawn.
+ */
+static int screen_row_changed(struct sviewer *sview, int row, int line,
+        int breakpt)
+{
+    struct source_row *old = &sview->screen.rows[row];
+    struct list_node *node = sview->cur;
+    struct source_row new;
+
+    new.node = node;
+    new.line = line;
+    new.sel_col = node->sel_col;
+    new.breakpt = breakpt;
+    new.exe_line = line == node->exe_line;
+    new.sel_line = line == node->sel_line;
+    new.match_beg = new.sel_line ? node->buf.match_beg : -1;
+    new.match_end = new.sel_line ? node->buf.match_end : -1;
+
+    if (old->node == new.node && old->line == new.line &&
+            old->sel_col == new.sel_col && old->breakpt == new.breakpt &&
+            old->exe_line == new.exe_line && old->sel_line == new.sel_line &&
+            old->match_beg == new.match_beg && old->match_end == new.match_end)
+        return 0;
+
+    *old = new;
+    return 1;
+}
+
 /* --------- */
 /* Functions */
 /* --------- */
@@ -419,8 +1795,36 @@ struct sviewer *source_new(int pos_r, int pos_c, int height, int width)
 
     /* Initialize the structure */
     rv->win = newwin(height, width, pos_r, pos_c);
+    idlok(rv->win, TRUE);
     rv->cur = NULL;
     rv->list_head = NULL;
+    rv->lru_head = NULL;
+    rv->lru_tail = NULL;
+    rv->memory = 0;
+    rv->break_head = NULL;
+    rv->prefetch_files = 0;
+    rv->prefetch_maxmemtot = 0;
+    memset(&rv->screen, 0, sizeof (struct source_screen));
+    rv->hls_regex = NULL;
+    rv->hls_icase = 0;
+    rv->hls_generation = 1;
+    memset(rv->hls_lines, 0, sizeof (rv->hls_lines));
+    rv->hls_cached = 0;
+
+#if HAVE_SYS_INOTIFY_H
+    rv->watch_fd = inotify_init();
+    if (rv->watch_fd != -1) {
+        fcntl(rv->watch_fd, F_SETFL,
+                fcntl(rv->watch_fd, F_GETFL) | O_NONBLOCK);
+        fcntl(rv->watch_fd, F_SETFD, FD_CLOEXEC);
+    }
+#else
+    rv->watch_fd = -1;
+#endif /* HAVE_SYS_INOTIFY_H */
+
+    /* The keys are owned by the nodes in the list */
+    rv->path_index = std_hash_table_new(std_str_hash, std_str_equal);
+    rv->lpath_index = std_hash_table_new(std_str_hash, std_str_equal);
 
     return rv;
 }
@@ -432,8 +1836,7 @@ int source_add(struct sviewer *sview, const char *path)
     new_node = malloc(sizeof (struct list_node));
     new_node->path = strdup(path);
     new_node->lpath = NULL;
-    new_node->buf.length = 0;
-    new_node->buf.tlines = NULL;    /* This signals an empty buffer */
+    init_file_buffer(&new_node->buf);
     new_node->sel_line = 0;
     new_node->sel_col = 0;
     new_node->sel_col_rbeg = 0;
@@ -441,6 +1844,19 @@ int source_add(struct sviewer *sview, const char *path)
     new_node->sel_rline = 0;
     new_node->exe_line = 0;
     new_node->last_modification = 0;    /* No timestamp yet */
+    new_node->breakpts = NULL;
+    new_node->breakpts_length = 0;
+    new_node->prefetch_skip = 0;
+    new_node->break_next = NULL;
+    new_node->memory = 0;
+    new_node->lru_prev = NULL;
+    new_node->lru_next = NULL;
+    new_node->watch = -1;
+    new_node->changed = 0;
+    new_node->last_check = 0;
+    new_node->hl_spans = NULL;
+    new_node->hl_checkpoints = NULL;
+    new_node->hl_generation = 0;
 
     if (sview->list_head == NULL) {
         /* List is empty, this is the first node */
@@ -452,62 +1868,77 @@ int source_add(struct sviewer *sview, const char *path)
         sview->list_head = new_node;
     }
 
+    std_hash_table_replace(sview->path_index, new_node->path, new_node);
+
     return 0;
 }
 
 int source_set_relative_path(struct sviewer *sview,
         const char *path, const char *lpath)
 {
+    struct list_node *node = get_node(sview, path);
 
-    struct list_node *node = sview->list_head;
+    if (!node)
+        return -1;
 
-    while (node != NULL) {
-        if (strcmp(node->path, path) == 0) {
-            node->lpath = strdup(lpath);
-            return 0;
-        }
+    if (node->lpath && strcmp(node->lpath, lpath) == 0)
+        return 0;
 
-        node = node->next;
+    if (node->lpath) {
+        if (get_relative_node(sview, node->lpath) == node)
+            std_hash_table_remove(sview->lpath_index, node->lpath);
+        free(node->lpath);
     }
 
-    return -1;
+    node->lpath = strdup(lpath);
+    std_hash_table_replace(sview->lpath_index, node->lpath, node);
+
+    return 0;
 }
 
 int source_del(struct sviewer *sview, const char *path)
 {
     struct list_node *cur;
     struct list_node *prev = NULL;
-    int i;
 
     /* Find the target node */
-    for (cur = sview->list_head; cur != NULL; cur = cur->next) {
-        if (strcmp(path, cur->path) == 0)
-            break;
-        prev = cur;
-    }
-
-    if (cur == NULL)
+    if ((cur = get_node(sview, path)) == NULL)
         return 1;               /* Node not found */
 
-    /* Release file buffer, if one is in memory */
-    if (cur->buf.tlines) {
-        for (i = 0; i < cur->buf.length; i++) {
-            free(cur->buf.tlines[i]);
-            if (cur->buf.cur_line) {
-                free(cur->buf.cur_line);
-                cur->buf.cur_line = NULL;
+    /* Find the node before it, to unlink it from the list */
+    if (cur != sview->list_head)
+        for (prev = sview->list_head; prev->next != cur; prev = prev->next);
+
+    std_hash_table_remove(sview->path_index, cur->path);
+
+    /* Another file may share the relative path, let it take over */
+    if (cur->lpath && get_relative_node(sview, cur->lpath) == cur) {
+        struct list_node *node;
+
+        std_hash_table_remove(sview->lpath_index, cur->lpath);
+        for (node = sview->list_head; node != NULL; node = node->next) {
+            if (node != cur && node->lpath &&
+                    strcmp(node->lpath, cur->lpath) == 0) {
+                std_hash_table_replace(sview->lpath_index, node->lpath, node);
+                break;
             }
-            free(cur->orig_buf.tlines[i]);
         }
     }
-    free(cur->buf.tlines);
-    free(cur->orig_buf.tlines);
 
-    /* Release the breakpoints */
-    if (cur->buf.breakpts) {
-        free(cur->buf.breakpts);
-        cur->buf.breakpts = NULL;
+    /* Release file buffer, if one is in memory */
+    if (is_loaded(sview, cur))
+        source_unload(sview, cur);
+
+    /* Unlink it from the files with breakpoints */
+    if (cur->breakpts_length > 0) {
+        struct list_node **link;
+
+        for (link = &sview->break_head; *link != cur;
+                link = &(*link)->break_next);
+        *link = cur->break_next;
     }
+    free(cur->breakpts);
+    cur->breakpts = NULL;
 
     /* Release file name */
     free(cur->path);
@@ -535,11 +1966,12 @@ int source_length(struct sviewer *sview, const char *path)
 {
     struct list_node *cur = get_node(sview, path);
 
-    if (!cur) {
-        /* Load the file if it's not already */
-        if (!cur->buf.tlines && load_file(cur))
-            return -1;
-    }
+    if (!cur)
+        return -1;
+
+    /* Load the file if it's not already */
+    if (!is_loaded(sview, cur) && source_load(sview, cur))
+        return -1;
 
     return cur->buf.length;
 }
@@ -561,14 +1993,27 @@ int source_display(struct sviewer *sview, int focus)
     int line;
     int i;
     int attr = 0, sellineno;
+    int breakpt;
 
     if (hl_groups_get_attr(hl_groups_instance, HLG_SELECTED_LINE_NUMBER,
                     &sellineno) == -1)
         return -1;
 
+    /* Load the file again if it was unloaded, and mark it as used */
+    if (sview->cur != NULL) {
+        if (!is_loaded(sview, sview->cur)) {
+            if (source_load(sview, sview->cur))
+                sview->cur = NULL;
+        } else if (sview->lru_head != sview->cur) {
+            lru_unlink(sview, sview->cur);
+            lru_push(sview, sview->cur);
+        }
+    }
+
     /* Check that a file is loaded */
-    if (sview->cur == NULL || sview->cur->buf.tlines == NULL) {
+    if (sview->cur == NULL || sview->cur->buf.length == 0) {
         logo_display(sview->win);
+        source_damage(sview);
         wrefresh(sview->win);
         return 0;
     }
@@ -583,21 +2028,27 @@ int source_display(struct sviewer *sview, int focus)
     getmaxyx(sview->win, height, width);
 
     /* Set starting line number (center source file if it's small enough) */
-    if (sview->cur->buf.length < height)
-        line = (sview->cur->buf.length - height) / 2;
-    else {
-        line = sview->cur->sel_line - height / 2;
-        if (line > sview->cur->buf.length - height)
-            line = sview->cur->buf.length - height;
-        else if (line < 0)
-            line = 0;
-    }
+    line = source_top_line(sview->cur, height);
+
+    /* Highlight the lines in the window, and a window full of lines on
+     * either side of it so that scrolling does not need to wait. When the
+     * worker thread is highlighting the file, the lines are drawn without
+     * color until it is done with them. */
+    if (highlight_request(sview->cur, line - height, line + 2 * height))
+        source_highlight(sview, sview->cur, line - height, line + 2 * height);
 
     /* Print 'height' lines of the file, starting at 'line' */
     lwidth = (int) log10(sview->cur->buf.length) + 1;
     sprintf(fmt, "%%%dd", lwidth);
 
+    /* Only the rows that changed since the last time are drawn */
+    screen_prepare(sview, line, height, width, lwidth, focus);
+
     for (i = 0; i < height; i++, line++) {
+        breakpt = get_break(sview->cur, line);
+        if (!screen_row_changed(sview, i, line, breakpt))
+            continue;
+
         wmove(sview->win, i, 0);
         if (has_colors()) {
             /* Outside of file, just finish drawing the vertical line */
@@ -617,7 +2068,7 @@ int source_display(struct sviewer *sview, int focus)
 
                 /* Mark the current line with an arrow */
             } else if (line == sview->cur->exe_line) {
-                switch (sview->cur->buf.breakpts[line]) {
+                switch (breakpt) {
                     case 0:
                         if (hl_groups_get_attr(hl_groups_instance, HLG_ARROW,
                                         &attr) == -1)
@@ -641,8 +2092,8 @@ int source_display(struct sviewer *sview, int focus)
                 draw_current_line(sview, line, lwidth);
 
                 /* Look for breakpoints */
-            } else if (sview->cur->buf.breakpts[line]) {
-                if (sview->cur->buf.breakpts[line] == 1) {
+            } else if (breakpt) {
+                if (breakpt == 1) {
                     if (hl_groups_get_attr(hl_groups_instance,
                                     HLG_ENABLED_BREAKPOINT, &attr) == -1)
                         return -1;
@@ -661,29 +2112,8 @@ int source_display(struct sviewer *sview, int focus)
                     wattroff(sview->win, A_BOLD);
                 waddch(sview->win, ' ');
 
-                /* I know this is rediculous, it needs to be reimplemented */
-                if (sources_syntax_on) {
-                    if (line == sview->cur->sel_line &&
-                            sview->cur->buf.cur_line != NULL) {
-                        hl_wprintw(sview->win, sview->cur->buf.cur_line,
-                                width - lwidth - 2, sview->cur->sel_col);
-
-                    } else {
-                        hl_wprintw(sview->win, sview->cur->buf.tlines[line],
-                                width - lwidth - 2, sview->cur->sel_col);
-                    }
-                } else {
-                    if (line == sview->cur->sel_line &&
-                            sview->cur->buf.cur_line != NULL) {
-                        hl_wprintw(sview->win, sview->cur->orig_buf.cur_line,
-                                width - lwidth - 2, sview->cur->sel_col);
-
-                    } else {
-                        hl_wprintw(sview->win,
-                                sview->cur->orig_buf.tlines[line],
-                                width - lwidth - 2, sview->cur->sel_col);
-                    }
-                }
+                source_print_line(sview, line, width - lwidth - 2,
+                        sview->cur->sel_col);
             }
             /* Ordinary lines */
             else {
@@ -702,49 +2132,81 @@ int source_display(struct sviewer *sview, int focus)
                     wattroff(sview->win, A_BOLD);
                 waddch(sview->win, ' ');
 
-                /* I know this is rediculous, it needs to be reimplemented */
-                if (sources_syntax_on) {
-                    /* No special line information */
-                    if (line == sview->cur->sel_line &&
-                            sview->cur->buf.cur_line != NULL) {
-                        hl_wprintw(sview->win, sview->cur->buf.cur_line,
-                                width - lwidth - 2, sview->cur->sel_col);
-
-                    } else {
-                        hl_wprintw(sview->win, sview->cur->buf.tlines[line],
-                                width - lwidth - 2, sview->cur->sel_col);
-                    }
-                } else {
-                    /* No special line information */
-                    if (line == sview->cur->sel_line &&
-                            sview->cur->buf.cur_line != NULL) {
-                        hl_wprintw(sview->win, sview->cur->orig_buf.cur_line,
-                                width - lwidth - 2, sview->cur->sel_col);
-
-                    } else {
-                        hl_wprintw(sview->win,
-                                sview->cur->orig_buf.tlines[line],
-                                width - lwidth - 2, sview->cur->sel_col);
-                    }
-                }
+                source_print_line(sview, line, width - lwidth - 2,
+                        sview->cur->sel_col);
             }
         } else {
-            wprintw(sview->win, "%s\n", sview->cur->buf.tlines[line]);
+            wprintw(sview->win, "%s\n", buffer_line(&sview->cur->buf, line));
         }
     }
 
     wmove(sview->win, height - (line - sview->cur->sel_line), lwidth + 2);
     wrefresh(sview->win);
 
+    /* The window of a large file may have moved, and the lines in the new
+     * window are not always highlighted the same */
+    if (sview->cur->buf.large) {
+        if (sview->cur->buf.wstart != sview->screen.wstart)
+            source_damage(sview);
+        source_account(sview, sview->cur);
+    }
+
     return 0;
 }
 
+void source_damage(struct sviewer *sview)
+{
+    if (sview)
+        sview->screen.node = NULL;
+}
+
+int source_highlight_ready(struct sviewer *sview)
+{
+    struct hl_result *r;
+    struct list_node *node;
+    const char *path;
+    int start, end, top, height;
+    int changed = 0;
+    long bytes, total = 0;
+
+    while ((r = highlight_get_result())) {
+        path = highlight_result_path(r, &start, &end);
+        node = get_node(sview, path);
+
+        /* The file was unloaded while the worker was busy with it */
+        if (!node || !is_loaded(sview, node)) {
+            highlight_free_result(r);
+            continue;
+        }
+
+        damage_lines(sview, node, start, end);
+        bytes = highlight_install_result(node, r);
+        node->memory += bytes;
+        sview->memory += bytes;
+        total += bytes;
+
+        if (node == sview->cur) {
+            height = getmaxy(sview->win);
+            top = source_top_line(node, height);
+            if (start < top + height && end > top)
+                changed = 1;
+        }
+    }
+
+    if (total > 0)
+        source_trim_memory(sview, sview->cur);
+
+    return changed;
+}
+
 void source_move(struct sviewer *sview,
         int pos_r, int pos_c, int height, int width)
 {
     delwin(sview->win);
     sview->win = newwin(height, width, pos_r, pos_c);
+    idlok(sview->win, TRUE);
     wclear(sview->win);
+    source_damage(sview);
 }
 
 void source_vscroll(struct sviewer *sview, int offset)
@@ -807,8 +2269,13 @@ int source_set_exec_line(struct sviewer *sview, const char *path, int line)
         return 3;
 
     /* Buffer the file if it's not already */
-    if (!sview->cur->buf.tlines && load_file(sview->cur))
-        return 4;
+    if (!is_loaded(sview, sview->cur)) {
+        if (source_load(sview, sview->cur))
+            return 4;
+    } else if (sview->lru_head != sview->cur) {
+        lru_unlink(sview, sview->cur);
+        lru_push(sview, sview->cur);
+    }
 
     /* Update line, if set */
     if (line--) {
@@ -829,14 +2296,43 @@ void source_free(struct sviewer *sview)
     while (sview->list_head != NULL)
         source_del(sview, sview->list_head->path);
 
+    std_hash_table_destroy(sview->path_index);
+    std_hash_table_destroy(sview->lpath_index);
+
+    if (sview->watch_fd != -1)
+        close(sview->watch_fd);
+
+    free(sview->screen.rows);
+    free(sview->hls_regex);
+    source_forget_matches(sview, NULL);
     delwin(sview->win);
 }
 
+void source_set_hlsearch(struct sviewer *sview, const char *regex)
+{
+    if (!sview)
+        return;
+
+    if (regex && *regex == '\0')
+        regex = NULL;
+
+    if (regex == sview->hls_regex ||
+            (regex && sview->hls_regex && strcmp(regex, sview->hls_regex) == 0))
+        return;
+
+    free(sview->hls_regex);
+    sview->hls_regex = regex ? cgdb_strdup(regex) : NULL;
+    sview->hls_icase = cgdbrc_get(CGDBRC_IGNORECASE)->variant.int_val;
+    sview->hls_generation++;
+}
+
 void source_search_regex_init(struct sviewer *sview)
 {
     if (sview == NULL || sview->cur == NULL)
         return;
 
+    hl_regex_forget(&sview->cur->buf);
+
     /* Start from beginning of line if not at same line */
     if (sview->cur->sel_rline != sview->cur->sel_line) {
         sview->cur->sel_col_rend = 0;
@@ -855,15 +2351,15 @@ int source_search_regex(struct sviewer *sview,
             strlen(regex) == 0) {
 
         if (sview && sview->cur)
-            sview->cur->buf.cur_line = NULL;
+            sview->cur->buf.match_beg = sview->cur->buf.match_end = -1;
         return -1;
     }
 
-    return hl_regex(regex,
-            (const char **) sview->cur->buf.tlines,
-            (const char **) sview->cur->orig_buf.tlines,
-            sview->cur->orig_buf.length,
-            &sview->cur->buf.cur_line, &sview->cur->sel_line,
+    /* The lines of a large file are loaded as they are asked for */
+    return hl_regex(regex, search_get_line, &sview->cur->buf,
+            sview->cur->buf.large ? NULL : sview->cur->buf.tlines,
+            sview->cur->buf.length, &sview->cur->buf.match_beg,
+            &sview->cur->buf.match_end, &sview->cur->sel_line,
             &sview->cur->sel_rline, &sview->cur->sel_col_rbeg,
             &sview->cur->sel_col_rend, opt, direction, icase);
 }
@@ -875,12 +2371,8 @@ void source_disable_break(struct sviewer *sview, const char *path, int line)
     if ((node = get_relative_node(sview, path)) == NULL)
         return;
 
-    if (node->buf.tlines == NULL)
-        if (load_file(node))
-            return;
-
-    if (line > 0 && line <= node->buf.length)
-        node->buf.breakpts[line - 1] = 2;
+    if (line > 0)
+        set_break(sview, node, line - 1, 2);
 }
 
 void source_enable_break(struct sviewer *sview, const char *path, int line)
@@ -890,55 +2382,173 @@ void source_enable_break(struct sviewer *sview, const char *path, int line)
     if ((node = get_relative_node(sview, path)) == NULL)
         return;
 
-    if (node->buf.tlines == NULL)
-        if (load_file(node))
-            return;
+    if (line > 0)
+        set_break(sview, node, line - 1, 1);
+}
 
-    if (line > 0 && line <= node->buf.length) {
-        node->buf.breakpts[line - 1] = 1;
-    }
+int source_get_break(struct sviewer *sview, int line)
+{
+    if (!sview || !sview->cur)
+        return 0;
+
+    return get_break(sview->cur, line);
 }
 
 void source_clear_breaks(struct sviewer *sview)
 {
+    struct list_node *node, *next;
+
+    for (node = sview->break_head; node != NULL; node = next) {
+        next = node->break_next;
+
+        free(node->breakpts);
+        node->breakpts = NULL;
+        node->breakpts_length = 0;
+        node->break_next = NULL;
+    }
+
+    sview->break_head = NULL;
+}
+
+int source_prefetch(struct sviewer *sview)
+{
+    int maxmemtot = cgdbrc_get(CGDBRC_MAXMEMTOT)->variant.int_val;
+    size_t budget = (size_t) maxmemtot * 1024;
+    size_t memory = sview->memory;
+    unsigned int files = 0;
+    struct list_node *node;
+    struct stat st;
+    int loaded = 0;
+
+    /* The breakpoints are all sent again each time one changes.  The
+     * files that were skipped are only tried again if that changed the
+     * files with breakpoints, which are hashed in any order. */
+    for (node = sview->break_head; node != NULL; node = node->break_next)
+        files += std_str_hash(node->path) * 2654435761u + 1;
+
+    if (files != sview->prefetch_files ||
+            maxmemtot != sview->prefetch_maxmemtot) {
+        for (node = sview->break_head; node != NULL;
+                node = node->break_next)
+            node->prefetch_skip = 0;
+        sview->prefetch_files = files;
+        sview->prefetch_maxmemtot = maxmemtot;
+    }
+
+    for (node = sview->break_head; node != NULL; node = node->break_next) {
+        if (loaded == SOURCE_PREFETCH_FILES)
+            break;
+
+        if (node->prefetch_skip || is_loaded(sview, node))
+            continue;
+
+        /* The file is read here, so only small files are read ahead.
+         * With its line index and highlighting, a file takes up a few
+         * times its size. */
+        if (stat(node->path, &st) == -1 ||
+                st.st_size > SOURCE_PREFETCH_SIZE ||
+                (budget != 0 && memory + 4 * st.st_size > budget) ||
+                source_read(sview, node)) {
+            node->prefetch_skip = 1;
+            continue;
+        }
+
+        /* Do not unload a file that was looked at for one that was not.
+         * It goes last in line to be unloaded, and if it does not fit
+         * after all, it is the one unloaded. */
+        lru_append(sview, node);
+        if (budget != 0 && sview->memory > budget) {
+            source_unload(sview, node);
+            node->prefetch_skip = 1;
+            continue;
+        }
+
+        memory += 4 * st.st_size;
+        loaded++;
+    }
+
+    return loaded;
+}
+
+int source_watch_fd(struct sviewer *sview)
+{
+    return sview ? sview->watch_fd : -1;
+}
+
+void source_watch_ready(struct sviewer *sview)
+{
+#if HAVE_SYS_INOTIFY_H
+    union {
+        struct inotify_event event;
+        char buf[4096];
+    } events;
+    struct inotify_event *event;
     struct list_node *node;
+    ssize_t size, pos;
 
-    for (node = sview->list_head; node != NULL; node = node->next)
-        memset(node->buf.breakpts, 0, node->buf.length);
+    if (!sview || sview->watch_fd == -1)
+        return;
+
+    while ((size = read(sview->watch_fd, events.buf,
+                            sizeof (events.buf))) > 0) {
+        for (pos = 0; pos < size;
+                pos += sizeof (struct inotify_event) + event->len) {
+            event = (struct inotify_event *) (events.buf + pos);
+
+            for (node = sview->lru_head; node; node = node->lru_next) {
+                /* Events were lost, any file may have changed */
+                if (event->mask & IN_Q_OVERFLOW) {
+                    node->changed = 1;
+                    continue;
+                }
+
+                if (node->watch != event->wd)
+                    continue;
 
+                node->changed = 1;
+
+                /* The watch is gone, poll until the file is read again */
+                if (event->mask & IN_IGNORED)
+                    node->watch = -1;
+            }
+        }
+    }
+#endif /* HAVE_SYS_INOTIFY_H */
 }
 
 int source_reload(struct sviewer *sview, const char *path, int force)
 {
     time_t timestamp;
     struct list_node *cur;
-    struct list_node *prev = NULL;
     int auto_source_reload =
             cgdbrc_get(CGDBRC_AUTOSOURCERELOAD)->variant.int_val;
 
     if (!path)
         return -1;
 
-    if (get_timestamp(path, &timestamp) == -1)
-        return -1;
-
     /* Find the target node */
-    for (cur = sview->list_head; cur != NULL; cur = cur->next) {
-        if (strcmp(path, cur->path) == 0)
-            break;
-        prev = cur;
-    }
-
-    if (cur == NULL)
+    if ((cur = get_node(sview, path)) == NULL)
         return 1;               /* Node not found */
 
-    if ((auto_source_reload || force) && cur->last_modification < timestamp) {
+    /* A file that is not loaded will be read fresh when it is displayed */
+    if (!is_loaded(sview, cur))
+        return 0;
+
+    if (!auto_source_reload && !force)
+        return 0;
 
-        if (release_file_memory(sview->cur) == -1)
-            return -1;
+    /* Only go to the file system when the file may have changed */
+    if (!force && !source_changed(sview, cur))
+        return 0;
 
-        if (load_file(cur))
+    if (get_timestamp(path, &timestamp) == -1)
+        return -1;
+
+    if (cur->changed || cur->last_modification < timestamp) {
+        if (source_update(sview, cur, timestamp)) {
+            source_unload(sview, cur);
             return -1;
+        }
     }
 
     return 0;
@@ -3,11 +3,13 @@
  * 
  * Source file management routines for the GUI.  Provides the ability to
  * add files to the list, load files, and display within a curses window.
- * Files are buffered in memory when they are displayed, and held in
- * memory for the duration of execution.  If memory consumption becomes a
- * problem, this can be optimized to unload files which have not been
- * displayed recently, or only load portions of large files at once. (May
- * affect syntax highlighting.)
+ * Files are read into memory when they are displayed.  The loaded files
+ * are kept on a least recently used list, and when they take up more memory
+ * than the maxmemtot option allows, the files which have not been displayed
+ * recently are unloaded.  An unloaded file keeps its path, breakpoints and
+ * selection, and is loaded again the next time it is displayed.
+ * Files bigger than the largefile option are not split into lines up front;
+ * only a window of lines around the selected line is kept in memory.
  *
  */
 
@@ -31,11 +33,33 @@
 #endif /* HAVE_TIME_H */
 
 #include "tokenizer.h"
+#include "std_hash.h"
 
 /* ----------- */
 /* Definitions */
 /* ----------- */
 
+/* How often a file that is not watched is checked for changes */
+#define SOURCE_POLL_INTERVAL 1
+
+/* The most files source_prefetch loads each time it is called */
+#define SOURCE_PREFETCH_FILES 4
+
+/* The largest file, in bytes, source_prefetch loads.  The files are read on
+ * the main thread, so this keeps it quick. */
+#define SOURCE_PREFETCH_SIZE (256 * 1024)
+
+/* The matches of the hlsearch pattern are kept for this many lines of the
+ * file being shown, which is more than a window is high */
+#define SOURCE_HLS_LINES 256
+
+/* Files at least as big as the largefile option are not split into lines
+ * when they are loaded.  Only where every SOURCE_LARGE_BLOCK-th line starts
+ * is remembered, and SOURCE_LARGE_WINDOW blocks of lines around the lines
+ * being looked at are kept in memory. */
+#define SOURCE_LARGE_BLOCK 1024
+#define SOURCE_LARGE_WINDOW 4
+
 /* Max length of a line */
 #define MAX_LINE        4096
 #define MAX_TITLE       40
@@ -46,19 +70,144 @@
 /* Data Structures */
 /* --------------- */
 
+/* What was drawn on a row of the source window */
+struct source_row {
+    struct list_node *node;     /* File drawn, or NULL to draw the row again */
+    int line;                   /* Line of the file drawn on the row */
+    int sel_col;                /* Column the line was scrolled to */
+    int breakpt;                /* Breakpoint on the line (0, 1 or 2) */
+    int exe_line;               /* Nonzero if the arrow was on the line */
+    int sel_line;               /* Nonzero if the line was selected */
+    int match_beg;              /* The search match drawn on the line */
+    int match_end;
+};
+
+/* What is on the screen, so that only the rows that changed are drawn.  If
+ * anything but the rows themselves changed, all of the rows are drawn. */
+struct source_screen {
+    struct list_node *node;     /* File drawn, or NULL to draw every row */
+    int top;                    /* Line drawn on the first row */
+    int height;                 /* Size of the window */
+    int width;
+    int lwidth;                 /* Width of the line numbers */
+    int focus;                  /* If the window had focus */
+    int tabstop;                /* Options the rows were drawn with */
+    int arrowstyle;
+    int syntax;
+    int language;
+    int wstart;                 /* Window of a large file, 0 otherwise */
+    unsigned long hlsearch;     /* Matches highlighted, 0 if none */
+    struct source_row *rows;    /* The 'height' rows of the window */
+};
+
+/* The matches of the hlsearch pattern on a line that was drawn */
+struct source_hls_line {
+    struct list_node *node;     /* The file, or NULL if the entry is unused */
+    int line;                   /* The line number */
+    struct hl_match *matches;
+};
+
 /* Source viewer object */
 struct sviewer {
     struct list_node *list_head;    /* File list */
     struct list_node *cur;      /* Current node we're displaying */
     WINDOW *win;                /* Curses window */
+
+    struct std_hashtable *path_index;   /* File list, keyed by path */
+    struct std_hashtable *lpath_index;  /* File list, keyed by lpath */
+
+    struct list_node *lru_head; /* Most recently used loaded file */
+    struct list_node *lru_tail; /* Least recently used loaded file */
+    size_t memory;              /* Bytes used by all the loaded files */
+
+    struct list_node *break_head;   /* First file with breakpoints */
+
+    /* The files with breakpoints that source_prefetch could not load are
+     * skipped until the files with breakpoints, or maxmemtot, change. */
+    unsigned int prefetch_files;    /* Hash of the files with breakpoints */
+    int prefetch_maxmemtot;     /* maxmemtot when the files were skipped */
+
+    int watch_fd;               /* inotify descriptor, or -1 if none */
+
+    struct source_screen screen;    /* What was drawn in win */
+
+    /* The pattern whose matches are highlighted when the hlsearch option
+     * is on.  The generation changes with the pattern, or with the
+     * ignorecase option, to tell the files their matches are stale. */
+    char *hls_regex;            /* The pattern, or NULL if none */
+    int hls_icase;              /* The ignorecase option it was used with */
+    unsigned long hls_generation;
+
+    /* The matches on the lines that were drawn, so they are not searched
+     * for each time.  A line is kept in the entry for its number modulo
+     * SOURCE_HLS_LINES.  They are for the hls_generation in hls_cached. */
+    struct source_hls_line hls_lines[SOURCE_HLS_LINES];
+    unsigned long hls_cached;
 };
 
 struct buffer {
     int length;                 /* Number of lines in buffer */
     char **tlines;              /* Array containing file ( lines of text ) */
-    char *cur_line;             /* cur line may have unique color */
-    char *breakpts;             /* Breakpoints */
+    int match_beg;              /* A search match on the selected line, */
+    int match_end;              /* which is -1 to -1 if there is none */
     int max_width;              /* Width of longest line in file */
+
+    /* A hash of each line, taken when the file was read.  When the file
+     * changes, the new lines are compared with these. */
+    unsigned int *hashes;
+
+    /* If text is non-NULL, tlines is an index into this single block and
+     * the lines are not allocated individually. */
+    char *text;                 /* Contents of the file, lines NUL split */
+    size_t text_size;           /* Size of the text block in bytes */
+
+    /* A large file has no text, tlines or hashes.  It is kept open, and the
+     * lines in the window are read from it. */
+    int large;                  /* Nonzero if this is a large file */
+    int fd;                     /* The open file, or -1 */
+    size_t *blocks;             /* Offset of every SOURCE_LARGE_BLOCK-th
+                                 * line, and of the end of the text */
+    char *window;               /* The lines in the window, NUL split */
+    char **wlines;              /* The lines in the window */
+    int wstart;                 /* The first line in the window */
+    int wlength;                /* The number of lines in the window */
+    struct hl_span **wspans;    /* Spans of the lines in the window, if */
+    enum tokenizer_language_support wlanguage;  /* highlighted as this */
+    long wspans_size;           /* Bytes used by wspans */
+};
+
+/* The state of the lexer at the start of a line */
+struct hl_checkpoint {
+    int state;                  /* State from tokenizer_get_state */
+    enum {
+        HL_STATE_UNKNOWN = 0,
+        HL_STATE_GUESSED,       /* Lexing did not start at the top */
+        HL_STATE_EXACT          /* Lexing started at the top */
+    } known;
+};
+
+/* A run of characters in a line that is drawn in one highlight group. The
+ * spans of a line are in order, and end with a span of length 0. Characters
+ * that are not in any span are drawn as HLG_TEXT.  The start of the last
+ * span is the state of the lexer at the end of the line, and its group is 1
+ * if that state is exact, or 0 if it was guessed. */
+struct hl_span {
+    int start;                  /* Index of the first character */
+    unsigned short length;      /* Number of characters */
+    unsigned short group;       /* The enum hl_group_kind to draw them in */
+};
+
+/* A match of a search pattern on a line.  The matches of a line are in
+ * order, and end with a match where beg is end. */
+struct hl_match {
+    int beg;                    /* Index of the first character */
+    int end;                    /* Index past the last character */
+};
+
+/* A breakpoint of a file */
+struct source_breakpt {
+    int line;                   /* Line of the breakpoint (0-based) */
+    char state;                 /* 1 if enabled, 2 if disabled */
 };
 
 struct list_node;
@@ -66,7 +215,6 @@ struct list_node {
     char *path;                 /* Full path to source file */
     char *lpath;                /* Relative path to source file */
     struct buffer buf;          /* File buffer */
-    struct buffer orig_buf;     /* Original File buffer ( no color ) */
     int sel_line;               /* Current line selected in viewer */
     int sel_col;                /* Current column selected in viewer */
     int exe_line;               /* Current line executing */
@@ -77,8 +225,35 @@ struct list_node {
 
     enum tokenizer_language_support language;   /* The language type of this file */
 
+    /* The spans of each line of buf.  These are NULL until the line is
+     * highlighted, and highlighting starts from the closest checkpoint. */
+    struct hl_span **hl_spans;
+    struct hl_checkpoint *hl_checkpoints;
+    unsigned long hl_generation;    /* Changes each time buf is reset */
+
     time_t last_modification;   /* timestamp of last modification */
 
+    /* Loaded files are watched for changes, so they do not have to be
+     * checked with stat() every time the program stops.  Files that can not
+     * be watched, or are on a network file system where changes made by
+     * other machines are not reported, are checked at most every
+     * SOURCE_POLL_INTERVAL seconds. */
+    int watch;                  /* inotify watch descriptor, or -1 */
+    int changed;                /* The file changed since it was read */
+    time_t last_check;          /* When the file was last checked */
+
+    /* The breakpoints of the file, sorted by line.  They are kept while the
+     * file is unloaded.  The files that have breakpoints are linked
+     * together, so they can be cleared without going through the others. */
+    struct source_breakpt *breakpts;
+    int breakpts_length;
+    struct list_node *break_next;   /* Next file with breakpoints */
+    int prefetch_skip;          /* source_prefetch could not load the file */
+
+    size_t memory;              /* Bytes used by the loaded file, or 0 */
+    struct list_node *lru_prev; /* More recently used loaded file */
+    struct list_node *lru_next; /* Less recently used loaded file */
+
     struct list_node *next;     /* Pointer to next link in list */
 };
 
@@ -163,6 +338,25 @@ char *source_current_file(struct sviewer *sview, char *path);
  */
 int source_display(struct sviewer *sview, int focus);
 
+/* source_damage:  Makes the next source_display draw every row.
+ * --------------
+ *
+ * This is needed when something else was drawn over the source window.
+ *
+ *   sview:  Source viewer object
+ */
+void source_damage(struct sviewer *sview);
+
+/* source_highlight_ready:  Stores the lines the highlight worker has done.
+ * -----------------------
+ *
+ *   sview:  Source viewer object
+ *
+ * Return Value:  1 if lines in the window changed and it should be displayed
+ *                again, 0 otherwise.
+ */
+int source_highlight_ready(struct sviewer *sview);
+
 /* source_move:  Relocate the source window.
  * ------------
  *
@@ -212,6 +406,17 @@ void source_set_sel_line(struct sviewer *sview, int line);
  */
 int source_set_exec_line(struct sviewer *sview, const char *path, int line);
 
+/* source_set_hlsearch: Sets the pattern whose matches are all highlighted,
+ * --------------------  when the hlsearch option is on.
+ *
+ * The matches are found as the lines are drawn, and kept with the lines
+ * until the pattern or the file changes.
+ *
+ *   sview:  Source viewer object
+ *   regex:  The pattern, or NULL to highlight no matches
+ */
+void source_set_hlsearch(struct sviewer *sview, const char *regex);
+
 /* source_search_regex_init: Should be called before source_search_regex
  * -------------------------
  *   This function initializes sview before it can search for a regex
@@ -273,6 +478,17 @@ void source_disable_break(struct sviewer *sview, const char *path, int line);
  */
 void source_enable_break(struct sviewer *sview, const char *path, int line);
 
+/* source_get_break:  Gets the breakpoint on a line of the current file.
+ * -----------------
+ *
+ *   sview:  The source viewer object
+ *   line:   The line number (0-based)
+ *
+ * Return Value:  0 if there is no breakpoint, 1 if it is enabled, or 2 if
+ *                it is disabled.
+ */
+int source_get_break(struct sviewer *sview, int line);
+
 /* source_clear_breaks:  Clear all breakpoints from all files.
  * --------------------
  *
@@ -280,6 +496,40 @@ void source_enable_break(struct sviewer *sview, const char *path, int line);
  */
 void source_clear_breaks(struct sviewer *sview);
 
+/* source_prefetch:  Loads files that have breakpoints before they are shown.
+ * ----------------
+ *
+ * The files are read, and highlighted in the background, so that they are
+ * ready when the program stops in them.  At most SOURCE_PREFETCH_FILES
+ * files of up to SOURCE_PREFETCH_SIZE bytes are loaded, and only while they
+ * fit in the maxmemtot budget.  They are the first files to be unloaded,
+ * since they have not been looked at, and loading them never unloads a file
+ * that was.  A file that is missing or does not fit is not tried again
+ * until the files with breakpoints, or maxmemtot, change.  Call this when
+ * the breakpoints are updated.
+ *
+ *   sview:  The source viewer object
+ *
+ * Return Value:  The number of files loaded.
+ */
+int source_prefetch(struct sviewer *sview);
+
+/* source_watch_fd:  Gets the descriptor that is readable when a loaded file
+ * ----------------  changes.
+ *
+ *   sview:  The source viewer object
+ *
+ * Return Value:  The descriptor, or -1 if files are not watched.
+ */
+int source_watch_fd(struct sviewer *sview);
+
+/* source_watch_ready:  Marks the loaded files that changed, after the
+ * -------------------  descriptor from source_watch_fd became readable.
+ *
+ *   sview:  The source viewer object
+ */
+void source_watch_ready(struct sviewer *sview);
+
 /**
  * Check's to see if the current source file has changed. If it has it loads
  * the new source file up.
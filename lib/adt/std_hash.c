@@ -17,6 +17,8 @@
  * Boston, MA 02111-1307, USA.
  */
 
+#include <string.h>
+
 #include "std_hash.h"
 
 #define HASH_TABLE_MIN_SIZE 11
@@ -690,3 +692,21 @@ unsigned int std_direct_hash(const void *v)
 {
     return (size_t) v;
 }
+
+int std_str_equal(const void *v, const void *v2)
+{
+    return strcmp((const char *) v, (const char *) v2) == 0;
+}
+
+/* This is the same hash (31 * h + c) that GLib uses for strings */
+unsigned int std_str_hash(const void *v)
+{
+    const signed char *p = v;
+    unsigned int h = *p;
+
+    if (h)
+        for (p += 1; *p != '\0'; p++)
+            h = (h << 5) - h + *p;
+
+    return h;
+}
@@ -306,10 +306,22 @@ unsigned int std_hash_table_size(struct std_hashtable *hash_table);
 
 /* 
  * Some standard hash functions 
- * TODO: These are unimplemented. Please implement them when needed.
+ * TODO: The int functions are unimplemented. Please implement them when 
+ * needed.
  */
 
+/**
+ * Compares two strings and returns 1 if they are equal. It can be passed
+ * to std_hash_table_new() as the key_equal_func parameter, when using
+ * strings as keys in a hash table.
+ */
 int std_str_equal(const void *v, const void *v2);
+
+/**
+ * Converts a string to a hash value. It can be passed to
+ * std_hash_table_new() as the hash_func parameter, when using strings as
+ * keys in a hash table.
+ */
 unsigned int std_str_hash(const void *v);
 int std_int_equal(const void *v, const void *v2);
 unsigned int std_int_hash(const void *v);
@@ -0,0 +1,194 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+/* For memmem, which the engines are compared with */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "search.h"
+
+/* The text searched, and the same text split into lines */
+static char *text;
+static size_t text_size;
+static char **lines;
+static int nlines;
+
+static const char *engines[] = { "auto", "scalar", "sse2", "avx2" };
+
+static void usage(void)
+{
+    printf("prefilter_driver <pattern> [file]\n");
+    printf("  Searches file, or a generated 32MB buffer if no file is\n");
+    printf("  given, for pattern with each search_memmem engine, and each\n");
+    printf("  line of it with and without the literal prefilter.\n");
+    exit(-1);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int read_text(const char *path)
+{
+    FILE *fd = fopen(path, "r");
+    size_t n;
+
+    if (!fd)
+        return -1;
+
+    while (1) {
+        text = realloc(text, text_size + 65536 + 1);
+        n = fread(text + text_size, 1, 65536, fd);
+        if (n == 0)
+            break;
+        text_size += n;
+    }
+
+    fclose(fd);
+    return 0;
+}
+
+/* Source-like lines with no uppercase letters in them */
+static void generate_text(void)
+{
+    static const char *words[] = { "int", "char", "return", "if", "for",
+        "buffer", "length", "(", ")", ";", "=", "+", "->", "i", "0", "1",
+        "while", "struct", "list_node", "sel_line", "*", "&&", "{", "}"
+    };
+    size_t size = 32 << 20;
+    unsigned int seed = 1;
+
+    text = malloc(size + 1);
+    while (text_size < size - 64) {
+        const char *w;
+
+        seed = seed * 1103515245 + 12345;
+        w = words[(seed >> 16) % (sizeof (words) / sizeof (words[0]))];
+        memcpy(text + text_size, w, strlen(w));
+        text_size += strlen(w);
+        text[text_size++] = (seed >> 8) % 9 == 0 ? '\n' : ' ';
+    }
+}
+
+static void split_lines(char *copy)
+{
+    char *s = copy;
+
+    memcpy(copy, text, text_size);
+    copy[text_size] = '\0';
+
+    while (s) {
+        if (nlines % 4096 == 0)
+            lines = realloc(lines, (nlines + 4096) * sizeof (char *));
+        lines[nlines++] = s;
+        s = strchr(s, '\n');
+        if (s)
+            *s++ = '\0';
+    }
+}
+
+int main(int argc, char **argv)
+{
+    regex_t t;
+    regmatch_t m;
+    struct search_pattern p, plain;
+    double start, elapsed;
+    int i, e, count;
+
+    if (argc != 2 && argc != 3)
+        usage();
+
+    if (argc == 3 && read_text(argv[2]) == -1) {
+        printf("%s:%d could not read %s\n", __FILE__, __LINE__, argv[2]);
+        return -1;
+    } else if (argc == 2)
+        generate_text();
+
+    if (regcomp(&t, argv[1], 0) != 0) {
+        printf("%s:%d bad pattern %s\n", __FILE__, __LINE__, argv[1]);
+        return -1;
+    }
+
+    search_pattern_init(&p, &t, argv[1], 0);
+    plain = p;
+    plain.literal = NULL;
+    plain.exact = 0;
+
+    split_lines(malloc(text_size + 1));
+    printf("%.1fMB, %d lines\n", text_size / 1048576.0, nlines);
+
+    /* Count the places the literal is in the whole text */
+    if (p.literal) {
+        const char *s = text;
+
+        printf("literal %.*s:\n", p.length, p.literal);
+
+        start = now();
+        count = 0;
+        while ((s = memmem(s, text + text_size - s, p.literal, p.length))) {
+            count++;
+            s++;
+        }
+        elapsed = now() - start;
+        printf("  memmem   %8d found %.3fs %7.0fMB/s\n", count, elapsed,
+                text_size / 1048576.0 / elapsed);
+
+        for (e = SEARCH_ENGINE_SCALAR; e <= SEARCH_ENGINE_AVX2; e++) {
+            s = text;
+            if (search_set_engine(e) == -1) {
+                printf("  %-8s not supported\n", engines[e]);
+                continue;
+            }
+
+            start = now();
+            count = 0;
+            while ((s = search_memmem(s, text + text_size - s,
+                                    p.literal, p.length))) {
+                count++;
+                s++;
+            }
+            elapsed = now() - start;
+            printf("  %-8s %8d found %.3fs %7.0fMB/s\n", engines[e], count,
+                    elapsed, text_size / 1048576.0 / elapsed);
+        }
+
+        search_set_engine(SEARCH_ENGINE_AUTO);
+    } else
+        printf("pattern does not start with a literal\n");
+
+    /* Find the first match on each line */
+    start = now();
+    count = 0;
+    for (i = 0; i < nlines; i++)
+        count += regexec(&t, lines[i], 1, &m, 0) == 0;
+    elapsed = now() - start;
+    printf("regexec    %8d lines %.3fs\n", count, elapsed);
+
+    start = now();
+    count = 0;
+    for (i = 0; i < nlines; i++)
+        count += search_first(&plain, lines[i], &m);
+    elapsed = now() - start;
+    printf("no filter  %8d lines %.3fs\n", count, elapsed);
+
+    start = now();
+    count = 0;
+    for (i = 0; i < nlines; i++)
+        count += search_first(&p, lines[i], &m);
+    elapsed = now() - start;
+    printf("prefilter  %8d lines %.3fs\n", count, elapsed);
+
+    regfree(&t);
+    return 0;
+}
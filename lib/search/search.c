@@ -0,0 +1,610 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#if HAVE_CTYPE_H
+#include <ctype.h>
+#endif /* HAVE_CTYPE_H */
+
+#if HAVE_LIMITS_H
+#include <limits.h>
+#endif /* HAVE_LIMITS_H */
+
+#if HAVE_SIGNAL_H
+#include <signal.h>
+#endif /* HAVE_SIGNAL_H */
+
+#if HAVE_STDLIB_H
+#include <stdlib.h>
+#endif /* HAVE_STDLIB_H */
+
+#if HAVE_STRING_H
+#include <string.h>
+#endif /* HAVE_STRING_H */
+
+#if HAVE_UNISTD_H
+#include <unistd.h>
+#endif /* HAVE_UNISTD_H */
+
+#if HAVE_PTHREAD_H && HAVE_LIBPTHREAD
+#include <pthread.h>
+#define SEARCH_THREADS 1
+#endif /* HAVE_PTHREAD_H && HAVE_LIBPTHREAD */
+
+/* SSE2 and AVX2 code is built with the target attribute, and the processor
+ * is asked at run time which of them it has */
+#if HAVE_IMMINTRIN_H && defined(__GNUC__) && \
+        (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+#include "search.h"
+
+/* The characters, other than letters and digits, that match themselves in a
+ * regular expression and do not change what the one before them means */
+static const char search_plain_chars[] = " _-:;,=<>/'\"#@!%&~`";
+
+/* The characters that make the one before them optional or repeated */
+static const char search_repeat[] = "*?+{\\";
+
+typedef const char *(*search_memmem_func) (const char *haystack,
+        size_t size, const char *needle, size_t length);
+
+/* The way search_memmem looks for text, NULL until it is chosen */
+static search_memmem_func search_memmem_engine = NULL;
+
+/* search_lines uses more than one thread for at least this many lines */
+#define SEARCH_PARALLEL_LINES 65536
+
+/* The number of lines a thread searches at a time */
+#define SEARCH_CHUNK_LINES 8192
+
+/* The most threads search_lines uses, counting the one that calls it */
+#define SEARCH_MAX_THREADS 8
+
+/* The most threads search_lines may use, or 0 for one per processor */
+static int search_threads = 0;
+
+/* A search_lines call that is split into chunks of lines */
+struct search_job {
+    const struct search_pattern *p;
+    char *const *lines;
+    int from;                   /* The line to search first */
+    int direction;              /* 1 if forward, -1 if reverse */
+    int count;                  /* The number of lines to search */
+    int chunks;                 /* The number of chunks they are split in */
+    int threads;                /* The number of threads that may help */
+    int next;                   /* The next chunk to search */
+    int best;                   /* The nearest chunk with a match in it,
+                                 * or chunks if there is none yet */
+    int line;                   /* The line that matched in it */
+    regmatch_t match;           /* Where it matched */
+};
+
+#ifdef SEARCH_THREADS
+
+/* The threads that help search_lines. They wait for a job, and work on
+ * it with the thread that posted it until there are no chunks left. */
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t work;        /* Signalled when a job is posted */
+    pthread_cond_t done;        /* Signalled when a thread finishes one */
+    int threads;                /* The number of threads, -1 until started */
+    unsigned long generation;   /* Changes each time a job is posted */
+    int busy;                   /* The threads still working on the job */
+    struct search_job *job;
+} search_pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, -1, 0, 0, NULL
+};
+
+#endif /* SEARCH_THREADS */
+
+/* search_regexec: Finds the first match in a line that starts at or after
+ * ---------------  a column.
+ *
+ * With REG_STARTEND, the text before the column is still looked at, so
+ * that \< and \> see the characters next to them.  Not every libc takes a
+ * non-zero start to mean REG_NOTBOL, so it is passed too, to keep ^ from
+ * matching at the column.
+ *
+ * Return Value: 1 if the line matched, 0 otherwise.
+ */
+static int search_regexec(const regex_t *t, const char *line, int column,
+        int length, regmatch_t *match)
+{
+#ifdef REG_STARTEND
+    match->rm_so = column;
+    match->rm_eo = length;
+    return regexec(t, line, 1, match,
+            REG_STARTEND | (column ? REG_NOTBOL : 0)) == 0;
+#else
+    if (regexec(t, line + column, 1, match, column ? REG_NOTBOL : 0) != 0)
+        return 0;
+
+    match->rm_so += column;
+    match->rm_eo += column;
+    return 1;
+#endif /* REG_STARTEND */
+}
+
+/* search_candidate: Finds where the next match could start.
+ * -----------------
+ *
+ * Return Value: The first column at or after column where the pattern's
+ *               literal starts, or -1 if it is not in the rest of the line.
+ */
+static int search_candidate(const struct search_pattern *p, const char *line,
+        int column, int length)
+{
+    const char *s;
+
+    if (!p->literal)
+        return column;
+
+    s = search_memmem(line + column, length - column, p->literal, p->length);
+    return s ? s - line : -1;
+}
+
+/* search_match: Finds the first match that starts at or after a column.
+ * -------------
+ *
+ * Return Value: 1 if the line matched, 0 otherwise.
+ */
+static int search_match(const struct search_pattern *p, const char *line,
+        int column, int length, regmatch_t *match)
+{
+    column = search_candidate(p, line, column, length);
+    if (column == -1)
+        return 0;
+
+    if (!p->exact)
+        return search_regexec(p->t, line, column, length, match);
+
+    match->rm_so = column;
+    match->rm_eo = column + p->length;
+    return 1;
+}
+
+int search_plain(char c)
+{
+    return isalnum((unsigned char) c) ||
+            (c != '\0' && strchr(search_plain_chars, c));
+}
+
+void search_pattern_init(struct search_pattern *p, const regex_t *t,
+        const char *pattern, int cflags)
+{
+    const char *s = pattern;
+    int n = 0;
+
+    p->t = t;
+    p->pattern = pattern;
+    p->cflags = cflags;
+    p->literal = NULL;
+    p->length = 0;
+    p->exact = 0;
+
+    /* A match of a pattern with alternatives in it can start with either */
+    if ((cflags & REG_ICASE) || strchr(pattern, '|'))
+        return;
+
+    if (*s == '^')
+        s++;
+
+    while (search_plain(s[n]))
+        n++;
+
+    /* A character that may not be there is not part of every match */
+    if (s[n] != '\0' && strchr(search_repeat, s[n]))
+        n--;
+
+    if (n <= 0)
+        return;
+
+    p->literal = s;
+    p->length = n;
+    p->exact = (s == pattern && s[n] == '\0');
+}
+
+int search_first(const struct search_pattern *p, const char *line,
+        regmatch_t *match)
+{
+    return search_match(p, line, 0, strlen(line), match);
+}
+
+int search_last(const struct search_pattern *p, const char *line,
+        int limit, regmatch_t *match)
+{
+    int length = strlen(line);
+    int column = 0;
+    int found = 0;
+    regmatch_t m;
+
+    if (limit >= length)
+        limit = length - 1;
+
+    /* Go from one match to the next, starting each one column past where
+     * the last one started, so that overlapping matches are found too */
+    while (column <= limit && search_match(p, line, column, length, &m)) {
+        if (m.rm_so > limit)
+            break;
+
+        *match = m;
+        found = 1;
+        column = m.rm_so + 1;
+    }
+
+    return found;
+}
+
+int search_next(const struct search_pattern *p, const char *line,
+        int column, int length, regmatch_t *match)
+{
+    if (column > length)
+        return 0;
+
+    return search_match(p, line, column, length, match);
+}
+
+/* search_line: Finds the match a search_lines call wants in a line.
+ * ------------
+ *
+ * Return Value: 1 if the line matched, 0 otherwise.
+ */
+static int search_line(const struct search_pattern *p, const char *line,
+        int direction, regmatch_t *match)
+{
+    if (direction > 0)
+        return search_first(p, line, match);
+
+    return search_last(p, line, INT_MAX, match);
+}
+
+/* search_job_run: Searches chunks of a job until none are left.
+ * ---------------
+ *
+ * Each chunk is searched in the direction of the job, and the first match
+ * in it is kept if no nearer chunk has one. Chunks past the nearest one
+ * with a match are not searched at all.
+ *
+ *  job - The job
+ *  p   - The pattern to search with, which the thread has to itself
+ */
+static void search_job_run(struct search_job *job,
+        const struct search_pattern *p)
+{
+    regmatch_t match;
+    int chunk, i, n;
+
+    while (1) {
+#ifdef SEARCH_THREADS
+        pthread_mutex_lock(&search_pool.mutex);
+#endif
+        chunk = job->next++;
+        if (chunk >= job->best)
+            chunk = -1;
+#ifdef SEARCH_THREADS
+        pthread_mutex_unlock(&search_pool.mutex);
+#endif
+
+        if (chunk == -1)
+            break;
+
+        i = job->from + job->direction * chunk * SEARCH_CHUNK_LINES;
+        n = job->count - chunk * SEARCH_CHUNK_LINES;
+        if (n > SEARCH_CHUNK_LINES)
+            n = SEARCH_CHUNK_LINES;
+
+        for (; n > 0; n--, i += job->direction) {
+            if (search_line(p, job->lines[i], job->direction, &match)) {
+#ifdef SEARCH_THREADS
+                pthread_mutex_lock(&search_pool.mutex);
+#endif
+                if (chunk < job->best) {
+                    job->best = chunk;
+                    job->line = i;
+                    job->match = match;
+                }
+#ifdef SEARCH_THREADS
+                pthread_mutex_unlock(&search_pool.mutex);
+#endif
+                break;
+            }
+        }
+    }
+}
+
+#ifdef SEARCH_THREADS
+
+/* search_pool_worker: The body of a thread that helps search_lines.
+ * -------------------
+ *
+ * regexec locks a compiled expression while it uses it, so each thread
+ * compiles its own copy of the pattern.
+ */
+static void *search_pool_worker(void *arg)
+{
+    int index = (int) (long) arg;
+    unsigned long generation = 0;
+
+    while (1) {
+        struct search_job *job;
+        struct search_pattern p;
+        regex_t t;
+
+        pthread_mutex_lock(&search_pool.mutex);
+        while (search_pool.generation == generation)
+            pthread_cond_wait(&search_pool.work, &search_pool.mutex);
+        generation = search_pool.generation;
+        job = search_pool.job;
+        pthread_mutex_unlock(&search_pool.mutex);
+
+        p = *job->p;
+        if (index + 1 < job->threads &&
+                (p.exact || regcomp(&t, p.pattern, p.cflags) == 0)) {
+            if (!p.exact)
+                p.t = &t;
+
+            search_job_run(job, &p);
+
+            if (!p.exact)
+                regfree(&t);
+        }
+
+        pthread_mutex_lock(&search_pool.mutex);
+        if (--search_pool.busy == 0)
+            pthread_cond_signal(&search_pool.done);
+        pthread_mutex_unlock(&search_pool.mutex);
+    }
+
+    return NULL;
+}
+
+/* search_pool_start: Starts the threads that help search_lines.
+ * ------------------
+ *
+ * One thread is started for each processor but the first, and no more
+ * than SEARCH_MAX_THREADS in all.  The search_memmem engine is chosen
+ * first, so that the threads never choose it at the same time.
+ */
+static void search_pool_start(void)
+{
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    sigset_t all, old;
+    pthread_t thread;
+
+    if (processors > SEARCH_MAX_THREADS)
+        processors = SEARCH_MAX_THREADS;
+
+    if (!search_memmem_engine)
+        search_set_engine(SEARCH_ENGINE_AUTO);
+
+    /* Signals are handled by the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+
+    search_pool.threads = 0;
+    while (search_pool.threads < processors - 1 &&
+            pthread_create(&thread, NULL, search_pool_worker,
+                    (void *) (long) search_pool.threads) == 0) {
+        pthread_detach(thread);
+        search_pool.threads++;
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+#endif /* SEARCH_THREADS */
+
+int search_lines(const struct search_pattern *p, char *const *lines,
+        int from, int to, int direction, regmatch_t *match)
+{
+    struct search_job job;
+
+    job.p = p;
+    job.lines = lines;
+    job.from = from;
+    job.direction = direction ? 1 : -1;
+    job.count = (to - from) * job.direction + 1;
+    if (job.count <= 0)
+        return -1;
+
+    job.chunks = (job.count + SEARCH_CHUNK_LINES - 1) / SEARCH_CHUNK_LINES;
+    job.threads = 1;
+    job.next = 0;
+    job.best = job.chunks;
+    job.line = -1;
+
+#ifdef SEARCH_THREADS
+    if (job.count >= SEARCH_PARALLEL_LINES && search_threads != 1) {
+        if (search_pool.threads == -1)
+            search_pool_start();
+
+        job.threads = search_pool.threads + 1;
+        if (search_threads > 0 && job.threads > search_threads)
+            job.threads = search_threads;
+    }
+
+    if (job.threads > 1) {
+        pthread_mutex_lock(&search_pool.mutex);
+        search_pool.job = &job;
+        search_pool.busy = search_pool.threads;
+        search_pool.generation++;
+        pthread_cond_broadcast(&search_pool.work);
+        pthread_mutex_unlock(&search_pool.mutex);
+
+        search_job_run(&job, p);
+
+        pthread_mutex_lock(&search_pool.mutex);
+        while (search_pool.busy > 0)
+            pthread_cond_wait(&search_pool.done, &search_pool.mutex);
+        pthread_mutex_unlock(&search_pool.mutex);
+    } else
+        search_job_run(&job, p);
+#else
+    search_job_run(&job, p);
+#endif /* SEARCH_THREADS */
+
+    if (job.line != -1)
+        *match = job.match;
+
+    return job.line;
+}
+
+void search_set_threads(int threads)
+{
+    search_threads = threads;
+}
+
+/* search_memmem_scalar: search_memmem one column at a time.
+ * ---------------------
+ */
+static const char *search_memmem_scalar(const char *haystack, size_t size,
+        const char *needle, size_t length)
+{
+    const char *s = haystack;
+    const char *end;
+
+    if (length == 0)
+        return haystack;
+
+    if (length > size)
+        return NULL;
+
+    end = haystack + size - length;
+    while (s <= end) {
+        s = memchr(s, needle[0], end - s + 1);
+        if (!s)
+            return NULL;
+
+        if (memcmp(s + 1, needle + 1, length - 1) == 0)
+            return s;
+
+        s++;
+    }
+
+    return NULL;
+}
+
+#ifdef SEARCH_X86
+
+/* search_memmem_sse2: search_memmem 16 columns at a time.
+ * -------------------
+ *
+ * The first and last character of needle are compared with 16 columns of
+ * haystack at once, and the rest of it only where both of them are equal.
+ */
+__attribute__ ((target("sse2")))
+static const char *search_memmem_sse2(const char *haystack, size_t size,
+        const char *needle, size_t length)
+{
+    __m128i first, last;
+    size_t i = 0;
+
+    if (length == 0 || length > size)
+        return search_memmem_scalar(haystack, size, needle, length);
+
+    first = _mm_set1_epi8(needle[0]);
+    last = _mm_set1_epi8(needle[length - 1]);
+
+    for (; i + length - 1 + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *) (haystack + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)
+                (haystack + i + length - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+                        _mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+
+        while (mask) {
+            const char *s = haystack + i + __builtin_ctz(mask);
+
+            if (memcmp(s + 1, needle + 1, length - 1) == 0)
+                return s;
+            mask &= mask - 1;
+        }
+    }
+
+    return search_memmem_scalar(haystack + i, size - i, needle, length);
+}
+
+/* search_memmem_avx2: search_memmem 32 columns at a time.
+ * -------------------
+ *
+ * The same as search_memmem_sse2, with registers twice as wide.
+ */
+__attribute__ ((target("avx2")))
+static const char *search_memmem_avx2(const char *haystack, size_t size,
+        const char *needle, size_t length)
+{
+    __m256i first, last;
+    size_t i = 0;
+
+    if (length == 0 || length > size)
+        return search_memmem_scalar(haystack, size, needle, length);
+
+    first = _mm256_set1_epi8(needle[0]);
+    last = _mm256_set1_epi8(needle[length - 1]);
+
+    for (; i + length - 1 + 32 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (haystack + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)
+                (haystack + i + length - 1));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(
+                        _mm256_cmpeq_epi8(a, first),
+                        _mm256_cmpeq_epi8(b, last)));
+
+        while (mask) {
+            const char *s = haystack + i + __builtin_ctz(mask);
+
+            if (memcmp(s + 1, needle + 1, length - 1) == 0)
+                return s;
+            mask &= mask - 1;
+        }
+    }
+
+    return search_memmem_sse2(haystack + i, size - i, needle, length);
+}
+
+#endif /* SEARCH_X86 */
+
+const char *search_memmem(const char *haystack, size_t size,
+        const char *needle, size_t length)
+{
+    if (!search_memmem_engine)
+        search_set_engine(SEARCH_ENGINE_AUTO);
+
+    return search_memmem_engine(haystack, size, needle, length);
+}
+
+int search_set_engine(enum search_engine engine)
+{
+#ifdef SEARCH_X86
+    __builtin_cpu_init();
+#endif
+
+    switch (engine) {
+        case SEARCH_ENGINE_AUTO:
+            if (search_set_engine(SEARCH_ENGINE_AVX2) == 0 ||
+                    search_set_engine(SEARCH_ENGINE_SSE2) == 0)
+                return 0;
+            return search_set_engine(SEARCH_ENGINE_SCALAR);
+        case SEARCH_ENGINE_SCALAR:
+            search_memmem_engine = search_memmem_scalar;
+            return 0;
+#ifdef SEARCH_X86
+        case SEARCH_ENGINE_SSE2:
+            if (!__builtin_cpu_supports("sse2"))
+                return -1;
+            search_memmem_engine = search_memmem_sse2;
+            return 0;
+        case SEARCH_ENGINE_AVX2:
+            if (!__builtin_cpu_supports("avx2"))
+                return -1;
+            search_memmem_engine = search_memmem_avx2;
+            return 0;
+#endif /* SEARCH_X86 */
+        default:
+            return -1;
+    }
+}
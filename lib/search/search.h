@@ -0,0 +1,178 @@
+#ifndef __SEARCH_H__
+#define __SEARCH_H__
+
+/*******************************************************************************
+ *
+ * This is the search unit. It finds where a pattern matches in a line of
+ * text, using a compiled regular expression.
+ *
+ * Most patterns are plain identifiers, or start with one. The text every
+ * match has to start with is looked for first, with SSE2 or AVX2 when the
+ * processor has them, and the regular expression is only run where that
+ * text is found. A pattern with no special characters in it at all is not
+ * run through the regular expression.
+ *
+ * Every function here looks at one line at a time. Walking through the
+ * lines of a file, and wrapping around at the ends, is left to the caller.
+ ******************************************************************************/
+
+#if HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif /* HAVE_SYS_TYPES_H */
+
+#if HAVE_REGEX_H
+#include <regex.h>
+#endif /* HAVE_REGEX_H */
+
+/* A pattern to search for */
+struct search_pattern {
+    const regex_t *t;           /* The compiled regular expression */
+    const char *pattern;        /* The text it was compiled from */
+    int cflags;                 /* The flags it was compiled with */
+    const char *literal;        /* Text every match starts with, or NULL */
+    int length;                 /* The length of literal */
+    int exact;                  /* Nonzero if literal is the whole match */
+};
+
+/* The ways search_memmem can look for text */
+enum search_engine {
+    SEARCH_ENGINE_AUTO = 0,     /* The fastest one the processor has */
+    SEARCH_ENGINE_SCALAR,       /* memchr and memcmp */
+    SEARCH_ENGINE_SSE2,         /* 16 columns at a time */
+    SEARCH_ENGINE_AVX2          /* 32 columns at a time */
+};
+
+/* search_plain:
+ * -------------
+ *
+ * Checks if a character in a pattern always matches itself, and does not
+ * change what the one before it means.
+ *
+ *  c - The character
+ *
+ *  Returns 1 if it is plain, 0 otherwise.
+ */
+int search_plain(char c);
+
+/* search_pattern_init:
+ * --------------------
+ *
+ * Sets up a pattern to search for.
+ *
+ *  p       - The pattern to set up
+ *  t       - The compiled regular expression, which must outlive p
+ *  pattern - The text t was compiled from, which must outlive p
+ *  cflags  - The flags t was compiled with
+ */
+void search_pattern_init(struct search_pattern *p, const regex_t *t,
+        const char *pattern, int cflags);
+
+/* search_first:
+ * -------------
+ *
+ * Finds the first match in a line.
+ *
+ *  p       - The pattern
+ *  line    - The line to search
+ *  match   - Set to where the match starts and ends
+ *
+ *  Returns 1 if the line matched, 0 otherwise.
+ */
+int search_first(const struct search_pattern *p, const char *line,
+        regmatch_t *match);
+
+/* search_last:
+ * ------------
+ *
+ * Finds the last match in a line that starts at or before limit.
+ *
+ * The line is scanned forward once, from one match to the next, so this
+ * takes about as long as search_first does on a line with no match.
+ *
+ *  p       - The pattern
+ *  line    - The line to search
+ *  limit   - The last column a match may start at
+ *  match   - Set to where the match starts and ends
+ *
+ *  Returns 1 if the line matched, 0 otherwise.
+ */
+int search_last(const struct search_pattern *p, const char *line,
+        int limit, regmatch_t *match);
+
+/* search_next:
+ * ------------
+ *
+ * Finds the first match in a line that starts at or after a column.  The
+ * text before the column is still seen, so ^ only matches at the start.
+ *
+ *  p       - The pattern
+ *  line    - The line to search
+ *  column  - The first column a match may start at
+ *  length  - The length of the line
+ *  match   - Set to where the match starts and ends
+ *
+ *  Returns 1 if the line matched, 0 otherwise.
+ */
+int search_next(const struct search_pattern *p, const char *line,
+        int column, int length, regmatch_t *match);
+
+/* search_lines:
+ * -------------
+ *
+ * Finds the nearest line that matches, going from one line to another.
+ *
+ * Many lines are split into chunks, which a few threads search at once.
+ * The lines must not change until this returns.
+ *
+ *  p         - The pattern
+ *  lines     - The lines
+ *  from      - The line to search first
+ *  to        - The line to search last
+ *  direction - 1 to search forward, 0 to search in reverse
+ *  match     - Set to where the first match in the line starts and ends,
+ *              or the last match if the search is in reverse
+ *
+ *  Returns the line that matched, or -1 if none of them did.
+ */
+int search_lines(const struct search_pattern *p, char *const *lines,
+        int from, int to, int direction, regmatch_t *match);
+
+/* search_set_threads:
+ * -------------------
+ *
+ * Sets the most threads search_lines may use.
+ *
+ *  threads - The number of threads, counting the one that calls
+ *            search_lines, or 0 for one per processor
+ */
+void search_set_threads(int threads);
+
+/* search_memmem:
+ * --------------
+ *
+ * Finds text in a block of memory.
+ *
+ *  haystack - The memory to look in
+ *  size     - The size of haystack
+ *  needle   - The text to look for
+ *  length   - The length of needle
+ *
+ *  Returns where needle first starts in haystack, or NULL if it is not
+ *  there.
+ */
+const char *search_memmem(const char *haystack, size_t size,
+        const char *needle, size_t length);
+
+/* search_set_engine:
+ * ------------------
+ *
+ * Chooses how search_memmem looks for text. The fastest way the processor
+ * can do it is used unless this is called.
+ *
+ *  engine - The way to look for text
+ *
+ *  Returns 0 on success, or -1 if the processor can not do it that way.
+ */
+int search_set_engine(enum search_engine engine);
+
+#endif /* __SEARCH_H__ */
@@ -0,0 +1,174 @@
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif /* HAVE_CONFIG_H */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "search.h"
+
+/* The lines searched */
+static char **lines;
+static int nlines;
+
+static void usage(void)
+{
+    printf("search_driver <pattern> [file]\n");
+    printf("  Finds the last match of pattern on each line of file, or of\n");
+    printf("  a generated buffer if no file is given, and prints how long\n");
+    printf("  each way of doing it took. Then finds the last line that\n");
+    printf("  matches, on one thread and on one per processor.\n");
+    exit(-1);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void add_line(const char *line)
+{
+    if (nlines % 1024 == 0)
+        lines = realloc(lines, (nlines + 1024) * sizeof (char *));
+    lines[nlines++] = strdup(line);
+}
+
+static int read_lines(const char *path)
+{
+    FILE *fd = fopen(path, "r");
+    char buf[1 << 16];
+
+    if (!fd)
+        return -1;
+
+    while (fgets(buf, sizeof (buf), fd)) {
+        buf[strcspn(buf, "\n")] = '\0';
+        add_line(buf);
+    }
+
+    fclose(fd);
+    return 0;
+}
+
+/* Source-like lines, with a few long ones, and no uppercase letters */
+static void generate_lines(void)
+{
+    char buf[4096];
+    int i, j;
+
+    for (i = 0; i < 20000; i++) {
+        int length = (i % 50 == 0) ? sizeof (buf) - 1 : 60 + i % 40;
+
+        for (j = 0; j < length; j++)
+            buf[j] = "abcdefghij klmnop_qrst(uvw);xyz"[(i * 7 + j * 13) % 31];
+        buf[length] = '\0';
+        add_line(buf);
+    }
+}
+
+/* The way hl_regex used to search backward: try the expression at each
+ * column of the line, from the end to the start. */
+static int old_last(const regex_t *t, const char *line, regmatch_t *match)
+{
+    int j;
+
+    for (j = strlen(line) - 1; j >= 0; j--) {
+        if (regexec(t, line + j, 1, match, 0) == 0) {
+            match->rm_so += j;
+            match->rm_eo += j;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    regex_t t;
+    regmatch_t m1, m2;
+    struct search_pattern p, plain;
+    double start, told, tregex, tliteral, tserial, tparallel;
+    int i, found = 0, differ = 0, l1, l2;
+
+    if (argc != 2 && argc != 3)
+        usage();
+
+    if (argc == 3 && read_lines(argv[2]) == -1) {
+        printf("%s:%d could not read %s\n", __FILE__, __LINE__, argv[2]);
+        return -1;
+    } else if (argc == 2)
+        generate_lines();
+
+    if (regcomp(&t, argv[1], 0) != 0) {
+        printf("%s:%d bad pattern %s\n", __FILE__, __LINE__, argv[1]);
+        return -1;
+    }
+
+    /* With and without looking for the text every match starts with */
+    search_pattern_init(&p, &t, argv[1], 0);
+    plain = p;
+    plain.literal = NULL;
+    plain.exact = 0;
+
+    start = now();
+    for (i = 0; i < nlines; i++)
+        old_last(&t, lines[i], &m1);
+    told = now() - start;
+
+    start = now();
+    for (i = 0; i < nlines; i++)
+        search_last(&plain, lines[i], strlen(lines[i]), &m2);
+    tregex = now() - start;
+
+    start = now();
+    for (i = 0; p.literal && i < nlines; i++)
+        search_last(&p, lines[i], strlen(lines[i]), &m2);
+    tliteral = now() - start;
+
+    /* Check that they all found the same thing. Patterns with ^ in them
+     * differ, since the old way matched it at every column. */
+    for (i = 0; i < nlines; i++) {
+        int r1 = old_last(&t, lines[i], &m1);
+        int r2 = search_last(&p, lines[i], strlen(lines[i]), &m2);
+
+        found += r1;
+        if (r1 != r2 || (r1 && (m1.rm_so != m2.rm_so ||
+                                m1.rm_eo != m2.rm_eo)))
+            differ++;
+    }
+
+    /* Find the last line that matches, on one thread and on as many as
+     * there are processors */
+    search_set_threads(1);
+    start = now();
+    l1 = search_lines(&p, lines, nlines - 1, 0, 0, &m1);
+    tserial = now() - start;
+
+    search_set_threads(0);
+    start = now();
+    l2 = search_lines(&p, lines, nlines - 1, 0, 0, &m2);
+    tparallel = now() - start;
+
+    if (l1 != l2 || (l1 != -1 && (m1.rm_so != m2.rm_so ||
+                            m1.rm_eo != m2.rm_eo)))
+        differ++;
+
+    printf("lines:   %d, %d matched, %d differ\n", nlines, found, differ);
+    printf("old:     %.3fs\n", told);
+    printf("regex:   %.3fs\n", tregex);
+    if (p.literal)
+        printf("literal: %.3fs (%.*s)\n", tliteral, p.length, p.literal);
+    else
+        printf("literal: pattern does not start with a literal\n");
+    printf("serial:  %.3fs, last match on line %d\n", tserial, l1);
+    printf("threads: %.3fs\n", tparallel);
+
+    regfree(&t);
+    return 0;
+}
@@ -3784,3 +3784,38 @@ int d_wrap ( void ) {
     return 1;
 }
 
+/* Returns the state of the lexer.  Lexing can be continued from this point
+ * in another buffer by passing it to d_set_buffer. */
+int d_get_state ( void ) {
+    /* The depth of a nesting comment is part of the state */
+    return YY_START | ( nesting_level << 8 );
+}
+
+/* Lexes a copy of SIZE bytes of BUFFER, starting in the lexer state STATE.
+ * If BUFFER is NULL, the copy of the last buffer is released. */
+void d_set_buffer ( const char *buffer, int size, int state ) {
+    static YY_BUFFER_STATE b = NULL;
+
+    if ( b ) {
+        d__delete_buffer( b );
+        b = NULL;
+    }
+
+    if ( buffer ) {
+        b = d__scan_bytes( buffer, size );
+        BEGIN( state & 0xff );
+        nesting_level = state >> 8;
+    }
+}
+
+/* Checks that STATE could have been returned by d_get_state. */
+int d_state_valid ( int state ) {
+    return state >= 0 && ( state & 0xff ) <= alt_wysiwyg_literal;
+}
+
+/* Returns the version of the lexer.  Change it when the states or the
+ * tokens of the lexer change, since states saved by another version of it
+ * may mean something else. */
+const char *d_get_version ( void ) {
+    return "d-1";
+}
@@ -2548,3 +2548,36 @@ int go_wrap ( void ) {
     return 1;
 }
 
+/* Returns the state of the lexer.  Lexing can be continued from this point
+ * in another buffer by passing it to go_set_buffer. */
+int go_get_state ( void ) {
+    return YY_START;
+}
+
+/* Lexes a copy of SIZE bytes of BUFFER, starting in the lexer state STATE.
+ * If BUFFER is NULL, the copy of the last buffer is released. */
+void go_set_buffer ( const char *buffer, int size, int state ) {
+    static YY_BUFFER_STATE b = NULL;
+
+    if ( b ) {
+        go__delete_buffer( b );
+        b = NULL;
+    }
+
+    if ( buffer ) {
+        b = go__scan_bytes( buffer, size );
+        BEGIN( state );
+    }
+}
+
+/* Checks that STATE could have been returned by go_get_state. */
+int go_state_valid ( int state ) {
+    return state >= INITIAL && state <= unicode_literal;
+}
+
+/* Returns the version of the lexer.  Change it when the states or the
+ * tokens of the lexer change, since states saved by another version of it
+ * may mean something else. */
+const char *go_get_version ( void ) {
+    return "go-1";
+}
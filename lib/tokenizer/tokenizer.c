@@ -1,6 +1,7 @@
 #include "tokenizer.h"
 #include "sys_util.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* Some default file extensions */
@@ -14,24 +15,48 @@ char *ada_extensions[] = { ".adb", ".ads", ".ada", ".ADB", ".ADS", ".ADA" };
 extern int c_lex(void);
 extern FILE *c_in;
 extern char *c_text;
+extern int c_get_state(void);
+extern void c_set_buffer(const char *buffer, int size, int state);
+extern int c_state_valid(int state);
+extern const char *c_get_version(void);
+extern void c_restart(FILE *input_file);
 
 extern int d_lex(void);
 extern FILE *d_in;
 extern char *d_text;
+extern int d_get_state(void);
+extern void d_set_buffer(const char *buffer, int size, int state);
+extern int d_state_valid(int state);
+extern const char *d_get_version(void);
+extern void d_restart(FILE *input_file);
 
 extern int go_lex(void);
 extern FILE *go_in;
 extern char *go_text;
+extern int go_get_state(void);
+extern void go_set_buffer(const char *buffer, int size, int state);
+extern int go_state_valid(int state);
+extern const char *go_get_version(void);
+extern void go_restart(FILE *input_file);
 
 extern int ada_lex(void);
 extern FILE *ada_in;
 extern char *ada_text;
+extern int ada_get_state(void);
+extern void ada_set_buffer(const char *buffer, int size, int state);
+extern int ada_state_valid(int state);
+extern const char *ada_get_version(void);
+extern void ada_restart(FILE *input_file);
 
 struct tokenizer {
     enum tokenizer_language_support lang;
     int (*tokenizer_lex) (void);
     FILE **tokenizer_in;
     char **tokenizer_text;
+    int (*tokenizer_get_state) (void);
+    void (*tokenizer_set_buffer) (const char *buffer, int size, int state);
+    void (*tokenizer_restart) (FILE * input_file);
+    int from_file;              /* 1 if lexing a file, 0 if a buffer */
 
     enum tokenizer_type tpacket;
     struct ibuf *i;
@@ -46,15 +71,38 @@ struct tokenizer *tokenizer_init(void)
     n->tokenizer_lex = NULL;
     n->tokenizer_in = NULL;
     n->tokenizer_text = NULL;
+    n->tokenizer_get_state = NULL;
+    n->tokenizer_set_buffer = NULL;
+    n->tokenizer_restart = NULL;
+    n->from_file = 0;
     return n;
 }
 
-int tokenizer_set_file(struct tokenizer *t, const char *file,
-        enum tokenizer_language_support l)
+void tokenizer_destroy(struct tokenizer *t)
 {
+    if (!t)
+        return;
+
+    /* Release the lexer's copy of the last buffer */
+    if (t->tokenizer_set_buffer)
+        (t->tokenizer_set_buffer) (NULL, 0, 0);
+
+    ibuf_free(t->i);
+    free(t);
+}
 
+/* tokenizer_set_language
+ * ----------------------
+ *
+ *  Selects the lexer the tokenizer will use.
+ *
+ *  Return: -1 if the language is not supported, 0 on success.
+ */
+static int tokenizer_set_language(struct tokenizer *t,
+        enum tokenizer_language_support l)
+{
     if (l < TOKENIZER_ENUM_START_POS || l >= TOKENIZER_LANGUAGE_UNKNOWN)
-        return 0;
+        return -1;
 
     t->lang = l;
 
@@ -62,20 +110,41 @@ int tokenizer_set_file(struct tokenizer *t, const char *file,
         t->tokenizer_lex = c_lex;
         t->tokenizer_in = &c_in;
         t->tokenizer_text = &c_text;
+        t->tokenizer_get_state = c_get_state;
+        t->tokenizer_set_buffer = c_set_buffer;
+        t->tokenizer_restart = c_restart;
     } else if (l == TOKENIZER_LANGUAGE_D) {
         t->tokenizer_lex = d_lex;
         t->tokenizer_in = &d_in;
         t->tokenizer_text = &d_text;
+        t->tokenizer_get_state = d_get_state;
+        t->tokenizer_set_buffer = d_set_buffer;
+        t->tokenizer_restart = d_restart;
     } else if (l == TOKENIZER_LANGUAGE_GO) {
         t->tokenizer_lex = go_lex;
         t->tokenizer_in = &go_in;
         t->tokenizer_text = &go_text;
+        t->tokenizer_get_state = go_get_state;
+        t->tokenizer_set_buffer = go_set_buffer;
+        t->tokenizer_restart = go_restart;
     } else {
         t->tokenizer_lex = ada_lex;
         t->tokenizer_in = &ada_in;
         t->tokenizer_text = &ada_text;
+        t->tokenizer_get_state = ada_get_state;
+        t->tokenizer_set_buffer = ada_set_buffer;
+        t->tokenizer_restart = ada_restart;
     }
 
+    return 0;
+}
+
+int tokenizer_set_file(struct tokenizer *t, const char *file,
+        enum tokenizer_language_support l)
+{
+    if (tokenizer_set_language(t, l) == -1)
+        return 0;
+
     *(t->tokenizer_in) = fopen(file, "r");
 
     if (!(*(t->tokenizer_in))) {
@@ -83,9 +152,69 @@ int tokenizer_set_file(struct tokenizer *t, const char *file,
         return -1;
     }
 
+    /* Start over in case the lexer was left at the end of another input */
+    (t->tokenizer_restart) (*(t->tokenizer_in));
+    t->from_file = 1;
+
+    return 0;
+}
+
+int tokenizer_set_buffer(struct tokenizer *t, const char *buffer, int size,
+        enum tokenizer_language_support l, int state)
+{
+    if (!buffer || size < 0)
+        return -1;
+
+    if (!tokenizer_state_valid(l, state) ||
+            tokenizer_set_language(t, l) == -1)
+        return -1;
+
+    (t->tokenizer_set_buffer) (buffer, size, state);
+    t->from_file = 0;
+
     return 0;
 }
 
+int tokenizer_state_valid(enum tokenizer_language_support l, int state)
+{
+    switch (l) {
+        case TOKENIZER_LANGUAGE_C:
+            return c_state_valid(state);
+        case TOKENIZER_LANGUAGE_D:
+            return d_state_valid(state);
+        case TOKENIZER_LANGUAGE_GO:
+            return go_state_valid(state);
+        case TOKENIZER_LANGUAGE_ADA:
+            return ada_state_valid(state);
+        default:
+            return 0;
+    }
+}
+
+const char *tokenizer_get_version(enum tokenizer_language_support l)
+{
+    switch (l) {
+        case TOKENIZER_LANGUAGE_C:
+            return c_get_version();
+        case TOKENIZER_LANGUAGE_D:
+            return d_get_version();
+        case TOKENIZER_LANGUAGE_GO:
+            return go_get_version();
+        case TOKENIZER_LANGUAGE_ADA:
+            return ada_get_version();
+        default:
+            return "";
+    }
+}
+
+int tokenizer_get_state(struct tokenizer *t)
+{
+    if (t == NULL || t->tokenizer_get_state == NULL)
+        return 0;
+
+    return (t->tokenizer_get_state) ();
+}
+
 int tokenizer_get_token(struct tokenizer *t)
 {
     if (t == NULL || t->tokenizer_lex == NULL)
@@ -96,7 +225,10 @@ int tokenizer_get_token(struct tokenizer *t)
     ibuf_add(t->i, (const char *) *(t->tokenizer_text));
 
     if (!(t->tpacket)) {
-        fclose(*(t->tokenizer_in));
+        if (t->from_file) {
+            fclose(*(t->tokenizer_in));
+            t->from_file = 0;
+        }
         return 0;
     }
 
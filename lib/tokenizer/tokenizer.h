@@ -60,6 +60,63 @@ void tokenizer_destroy(struct tokenizer *t);
 int tokenizer_set_file(struct tokenizer *t, const char *file,
         enum tokenizer_language_support l);
 
+/* tokenizer_set_buffer
+ * --------------------
+ *
+ *  This functions will prepare the tokenizer to parse a buffer in memory.
+ *  The buffer is copied, so it does not need to be kept around.
+ *  
+ *  t:      The tokenizer object to work on
+ *  buffer: The text to tokenize.
+ *  size:   The number of bytes in buffer.
+ *  l:      The language of the text.
+ *  state:  The state to start the lexer in. This is 0 for the beginning
+ *          of a file, or a value returned by tokenizer_get_state.
+ *
+ *  Return: -1 on error. 0 on success
+ */
+int tokenizer_set_buffer(struct tokenizer *t, const char *buffer, int size,
+        enum tokenizer_language_support l, int state);
+
+/* tokenizer_get_state
+ * -------------------
+ *
+ *  This gets the state of the lexer, for instance if it is in the middle
+ *  of a comment. When taken after a TOKENIZER_NEWLINE token, it can be
+ *  passed to tokenizer_set_buffer to tokenize the text following the
+ *  newline, without tokenizing the text in front of it again.
+ *
+ *  t:      The tokenizer object to work on
+ *
+ *  Return: The state of the lexer.
+ */
+int tokenizer_get_state(struct tokenizer *t);
+
+/* tokenizer_state_valid
+ * ---------------------
+ *
+ *  Checks a lexer state, for instance one read back from a file, before
+ *  it is passed to tokenizer_set_buffer.
+ *
+ *  l:      The language of the lexer
+ *  state:  The state to check
+ *
+ *  Return: 1 if the lexer of l could be in state, 0 otherwise.
+ */
+int tokenizer_state_valid(enum tokenizer_language_support l, int state);
+
+/* tokenizer_get_version
+ * ---------------------
+ *
+ *  States saved by one version of a lexer may mean something else to
+ *  another. The version changes when the states or tokens of the lexer do.
+ *
+ *  l:      The language of the lexer
+ *
+ *  Return: The version of the lexer of l.
+ */
+const char *tokenizer_get_version(enum tokenizer_language_support l);
+
 /* tokenizer_get_token
  * -------------------
  *